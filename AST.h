@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
@@ -20,34 +21,48 @@ struct Parameter {
   std::string toString() const;
 };
 
+enum ExprKind {
+  EK_Error,
+  EK_VarRef,
+  EK_IntConstant,
+  EK_BoolConstant,
+  EK_UnOp,
+  EK_BinOp,
+};
+
 struct Expression {
+  ExprKind exprKind;
   Type type;
 
-  Expression(Type type) : type(type) {}
+  Expression(ExprKind exprKind, Type type) : exprKind(exprKind), type(type) {}
   virtual ~Expression() = default;
 };
 
 struct ErrorExpression final : Expression {
-  ErrorExpression(Type type) : Expression(type) {}
+  ErrorExpression(Type type) : Expression(EK_Error, type) {}
 };
 
 struct VarRef final : Expression {
   std::string identifier;
+  // index of the referenced parameter, resolved by ASTBuilder
+  size_t slot;
 
-  VarRef(std::string identifier, Type type)
-      : identifier(identifier), Expression(type) {}
+  VarRef(std::string identifier, Type type, size_t slot)
+      : identifier(identifier), slot(slot), Expression(EK_VarRef, type) {}
 };
 
 struct IntConstant final : Expression {
   int64_t value;
 
-  IntConstant(int64_t value) : value(value), Expression(T_INT) {}
+  IntConstant(int64_t value)
+      : value(value), Expression(EK_IntConstant, T_INT) {}
 };
 
 struct BoolConstant final : Expression {
   bool value;
 
-  BoolConstant(bool value) : value(value), Expression(T_BOOL) {}
+  BoolConstant(bool value)
+      : value(value), Expression(EK_BoolConstant, T_BOOL) {}
 };
 
 enum UnOpKind {
@@ -59,7 +74,7 @@ struct UnOp final : Expression {
   std::shared_ptr<Expression> subExpr;
 
   UnOp(UnOpKind kind, std::shared_ptr<Expression> subExpr, Type type)
-      : Expression(type), kind(kind), subExpr(std::move(subExpr)) {}
+      : Expression(EK_UnOp, type), kind(kind), subExpr(std::move(subExpr)) {}
 };
 
 enum BinOpKind {
@@ -80,33 +95,85 @@ struct BinOp final : Expression {
 
   BinOp(BinOpKind kind, std::shared_ptr<Expression> lhs,
         std::shared_ptr<Expression> rhs, Type type)
-      : Expression(type), kind(kind), lhs(std::move(lhs)), rhs(std::move(rhs)) {
-  }
+      : Expression(EK_BinOp, type), kind(kind), lhs(std::move(lhs)),
+        rhs(std::move(rhs)) {}
+};
+
+// Compact encoding of a function's expressions: every expression is laid out
+// in post-order in one contiguous node array, operands before their operator.
+enum FlatOpcode {
+  FO_Error,
+  FO_VarRef,
+  FO_IntConstant,
+  FO_BoolConstant,
+  FO_Neg,
+  FO_Add,
+  FO_Sub,
+  FO_Lt,
+  FO_Gt,
+  FO_LAnd,
+  FO_LOr,
+};
+
+struct FlatNode {
+  FlatOpcode opcode;
+  Type type;
+  uint32_t lhs = 0;
+  uint32_t rhs = 0;
+  // constant value, or parameter index for FO_VarRef
+  int64_t value = 0;
+};
+
+// Subtree [begin, end) of FlatCode::nodes; its root is the node at end - 1.
+struct FlatRange {
+  uint32_t begin = 0;
+  uint32_t end = 0;
+};
+
+struct FlatCode {
+  std::vector<FlatNode> nodes;
+};
+
+enum StmtKind {
+  SK_Error,
+  SK_Assignment,
+  SK_If,
 };
 
 struct Statement {
+  StmtKind stmtKind;
+
+  Statement(StmtKind stmtKind) : stmtKind(stmtKind) {}
   virtual ~Statement() = default;
 };
 
-struct ErrorStatement final : Statement {};
+struct ErrorStatement final : Statement {
+  ErrorStatement() : Statement(SK_Error) {}
+};
 
 struct Assignment final : Statement {
   std::string var;
+  // index of the assigned parameter, resolved by ASTBuilder
+  size_t slot;
   std::shared_ptr<Expression> value;
+  FlatRange valueCode;
 
-  Assignment(std::string var, std::shared_ptr<Expression> value)
-      : var(std::move(var)), value(std::move(value)) {}
+  Assignment(std::string var, size_t slot, std::shared_ptr<Expression> value)
+      : Statement(SK_Assignment), var(std::move(var)), slot(slot),
+        value(std::move(value)) {}
 };
 
 struct IfStmt final : Statement {
   std::shared_ptr<Expression> condition;
+  FlatRange conditionCode;
   std::vector<std::shared_ptr<Statement>> thenBlock;
   std::vector<std::shared_ptr<Statement>> elseBlock;
 
   IfStmt(std::shared_ptr<Expression> condition,
          std::vector<std::shared_ptr<Statement>> thenBlock,
          std::vector<std::shared_ptr<Statement>> elseBlock)
-      : condition(condition), thenBlock(thenBlock), elseBlock(elseBlock) {}
+      : Statement(SK_If), condition(condition), thenBlock(thenBlock),
+        elseBlock(elseBlock) {}
 };
 
 struct Function {
@@ -114,6 +181,9 @@ struct Function {
   std::vector<std::shared_ptr<Statement>> body;
   Type returnType;
   std::shared_ptr<Expression> returnValue;
+  FlatRange returnCode;
+  // set only when the AST builder was asked to emit flat code
+  std::shared_ptr<const FlatCode> code;
 };
 
 } // namespace mysym
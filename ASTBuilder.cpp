@@ -10,7 +10,11 @@ namespace {
 
 class ASTBuilderImpl : public IASTBuilder {
 public:
-  ASTBuilderImpl() : function(std::make_shared<Function>()) {}
+  explicit ASTBuilderImpl(bool emitFlatCode)
+      : function(std::make_shared<Function>()),
+        code(emitFlatCode ? std::make_shared<FlatCode>() : nullptr) {
+    function->code = code;
+  }
   ~ASTBuilderImpl() override = default;
 
   void enterFunction(LangParser::FunctionContext *ctx) override;
@@ -51,6 +55,8 @@ private:
   std::optional<int64_t> parseInt(tree::TerminalNode *node);
 
   void pushExpr(std::shared_ptr<Expression> expression) {
+    if (code)
+      emitFlat(*expression);
     expressionStack.emplace_back(std::move(expression));
   }
   std::shared_ptr<Expression> popExpr() {
@@ -74,11 +80,20 @@ private:
 
   void checkExpressionStackForBinop();
 
+  void emitFlat(const Expression &expression);
+  FlatRange flatRangeOf(const std::shared_ptr<Expression> &expression) const {
+    if (!code)
+      return {};
+    return flatRanges.at(expression.get());
+  }
+
 private:
   std::shared_ptr<Function> function;
   std::vector<std::shared_ptr<Expression>> expressionStack;
   std::vector<std::shared_ptr<Statement>> statementStack;
   std::unordered_map<std::string, size_t> parameters;
+  std::shared_ptr<FlatCode> code;
+  std::unordered_map<const Expression *, FlatRange> flatRanges;
   size_t errorCount = 0;
 };
 
@@ -124,6 +139,7 @@ void ASTBuilderImpl::exitReturnstmt(LangParser::ReturnstmtContext *ctx) {
         "expression stack is empty at the return statement");
   }
   function->returnValue = popExpr();
+  function->returnCode = flatRangeOf(function->returnValue);
   if (function->returnValue->type != function->returnType) {
     reportError(ctx, fmt::format("return value of type {} does not match with "
                                  "expected return type {}",
@@ -166,8 +182,10 @@ void ASTBuilderImpl::exitIfstmt(LangParser::IfstmtContext *ctx) {
                     toString(condition->type)));
     return pushErrorStmt();
   }
+  FlatRange conditionCode = flatRangeOf(condition);
   auto ifstmt = std::make_shared<IfStmt>(
       std::move(condition), std::move(thenBody), std::move(elseBody));
+  ifstmt->conditionCode = conditionCode;
   pushStmt(std::move(ifstmt));
 }
 
@@ -191,8 +209,10 @@ void ASTBuilderImpl::exitAssign(LangParser::AssignContext *ctx) {
                             toString(parameterType), toString(parameterType)));
     return pushErrorStmt();
   }
-  auto assignment =
-      std::make_shared<Assignment>(std::move(varName), std::move(rhs));
+  FlatRange valueCode = flatRangeOf(rhs);
+  auto assignment = std::make_shared<Assignment>(
+      std::move(varName), parameterIndex, std::move(rhs));
+  assignment->valueCode = valueCode;
   pushStmt(assignment);
 }
 
@@ -290,8 +310,8 @@ void ASTBuilderImpl::enterVarrefexpr(LangParser::VarrefexprContext *ctx) {
     reportError(ctx, fmt::format("unresolved reference to {}", name));
     return pushErrorExpr(T_INT);
   }
-  pushExpr(std::make_shared<VarRef>(std::move(name),
-                                    function->parameters[it->second].type));
+  pushExpr(std::make_shared<VarRef>(
+      std::move(name), function->parameters[it->second].type, it->second));
 }
 
 void ASTBuilderImpl::reportError(tree::ParseTree *, std::string details) {
@@ -324,6 +344,71 @@ void ASTBuilderImpl::checkExpressionStackForBinop() {
   }
 }
 
-std::shared_ptr<IASTBuilder> IASTBuilder::create() {
-  return std::make_shared<ASTBuilderImpl>();
+static FlatOpcode getFlatOpcode(BinOpKind kind) {
+  switch (kind) {
+  case BO_Add:
+    return FO_Add;
+  case BO_Sub:
+    return FO_Sub;
+  case BO_Lt:
+    return FO_Lt;
+  case BO_Gt:
+    return FO_Gt;
+  case BO_LAnd:
+    return FO_LAnd;
+  case BO_LOr:
+    return FO_LOr;
+  }
+  assert(false && "invalid binop");
+  return FO_Error;
+}
+
+void ASTBuilderImpl::emitFlat(const Expression &expression) {
+  auto index = static_cast<uint32_t>(code->nodes.size());
+  FlatNode node{};
+  node.opcode = FO_Error;
+  node.type = expression.type;
+  uint32_t begin = index;
+  switch (expression.exprKind) {
+  case EK_Error:
+    break;
+  case EK_VarRef: {
+    auto &varRef = static_cast<const VarRef &>(expression);
+    node.opcode = FO_VarRef;
+    node.value = static_cast<int64_t>(varRef.slot);
+    break;
+  }
+  case EK_IntConstant:
+    node.opcode = FO_IntConstant;
+    node.value = static_cast<const IntConstant &>(expression).value;
+    break;
+  case EK_BoolConstant:
+    node.opcode = FO_BoolConstant;
+    node.value = static_cast<const BoolConstant &>(expression).value;
+    break;
+  case EK_UnOp: {
+    auto &unop = static_cast<const UnOp &>(expression);
+    FlatRange subExpr = flatRangeOf(unop.subExpr);
+    node.opcode = FO_Neg;
+    node.lhs = subExpr.end - 1;
+    begin = subExpr.begin;
+    break;
+  }
+  case EK_BinOp: {
+    auto &binop = static_cast<const BinOp &>(expression);
+    FlatRange lhs = flatRangeOf(binop.lhs);
+    FlatRange rhs = flatRangeOf(binop.rhs);
+    node.opcode = getFlatOpcode(binop.kind);
+    node.lhs = lhs.end - 1;
+    node.rhs = rhs.end - 1;
+    begin = lhs.begin;
+    break;
+  }
+  }
+  code->nodes.push_back(node);
+  flatRanges[&expression] = FlatRange{.begin = begin, .end = index + 1};
+}
+
+std::shared_ptr<IASTBuilder> IASTBuilder::create(bool emitFlatCode) {
+  return std::make_shared<ASTBuilderImpl>(emitFlatCode);
 }
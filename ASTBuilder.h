@@ -8,7 +8,9 @@ struct Function;
 
 class IASTBuilder : public LangBaseListener {
 public:
-  static std::shared_ptr<IASTBuilder> create();
+  // With emitFlatCode, the built Function also carries a FlatCode encoding of
+  // its expressions which the interpreter evaluates instead of the tree.
+  static std::shared_ptr<IASTBuilder> create(bool emitFlatCode = false);
 
   virtual std::shared_ptr<Function> getFunction() = 0;
 
@@ -0,0 +1,539 @@
+#include "ExprFactory.h"
+#include <algorithm>
+#include <functional>
+#include <new>
+#include <optional>
+
+using namespace mysym;
+
+void *ExprArena::allocate(size_t size, size_t alignment) {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto &[blockSize, head] : freeBlocks) {
+    if (blockSize != size || !head ||
+        reinterpret_cast<uintptr_t>(head) % alignment != 0)
+      continue;
+    FreeBlock *block = head;
+    head = block->next;
+    allocated += size;
+    return block;
+  }
+
+  auto address = reinterpret_cast<uintptr_t>(cursor);
+  uintptr_t aligned = (address + alignment - 1) & ~(uintptr_t(alignment) - 1);
+  if (!cursor || aligned + size > reinterpret_cast<uintptr_t>(end)) {
+    size_t required = size + alignment;
+    size_t newChunkSize = std::max(chunkSize, required);
+    chunks.emplace_back(std::make_unique<char[]>(newChunkSize));
+    cursor = chunks.back().get();
+    end = cursor + newChunkSize;
+    address = reinterpret_cast<uintptr_t>(cursor);
+    aligned = (address + alignment - 1) & ~(uintptr_t(alignment) - 1);
+  }
+  cursor = reinterpret_cast<char *>(aligned + size);
+  allocated += size;
+  return reinterpret_cast<void *>(aligned);
+}
+
+void ExprArena::deallocate(void *block, size_t size) {
+  std::lock_guard<std::mutex> lock(mutex);
+  allocated -= size;
+  // a block too small to link is left unused
+  if (size < sizeof(FreeBlock))
+    return;
+  auto it = std::find_if(
+      freeBlocks.begin(), freeBlocks.end(),
+      [size](const auto &list) { return list.first == size; });
+  if (it == freeBlocks.end())
+    it = freeBlocks.emplace(freeBlocks.end(), size, nullptr);
+  it->second = new (block) FreeBlock{it->second};
+}
+
+size_t ExprArena::bytesAllocated() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return allocated;
+}
+
+static size_t combineHash(size_t seed, size_t value) {
+  return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+size_t ExprFactory::KeyHash::operator()(const Key &key) const {
+  size_t hash = std::hash<int>()(key.kind);
+  hash = combineHash(hash, std::hash<const void *>()(key.condition));
+  hash = combineHash(hash, std::hash<const void *>()(key.lhs));
+  hash = combineHash(hash, std::hash<const void *>()(key.rhs));
+  hash = combineHash(hash, std::hash<int64_t>()(key.value));
+  for (const auto &[symbol, coefficient] : key.terms) {
+    hash = combineHash(hash, std::hash<const void *>()(symbol));
+    hash = combineHash(hash, std::hash<int64_t>()(coefficient));
+  }
+  if (!key.identifier.empty())
+    hash = combineHash(hash, std::hash<std::string>()(key.identifier));
+  return hash;
+}
+
+template <typename T, typename Result, typename... Args>
+std::shared_ptr<Result> ExprFactory::intern(Key key, Args &&...args) {
+  Shard &shard = shards[KeyHash()(key) % shardCount];
+  std::shared_ptr<T> node;
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.nodes.find(key);
+    if (it != shard.nodes.end())
+      return std::static_pointer_cast<Result>(
+          std::static_pointer_cast<T>(it->second));
+    node = std::allocate_shared<T>(ArenaAllocator<T>(shard.arena),
+                                   std::forward<Args>(args)...);
+    auto entry = shard.nodes.emplace(std::move(key), node).first;
+    // taken under the lock, so that order stays sorted
+    shard.order.emplace_back(sequence.fetch_add(1, std::memory_order_relaxed),
+                             &*entry);
+  }
+  created.fetch_add(1, std::memory_order_relaxed);
+  if (interned.fetch_add(1, std::memory_order_relaxed) + 1 >=
+      collectAt.load(std::memory_order_relaxed))
+    collect();
+  return node;
+}
+
+void ExprFactory::collect() {
+  std::unique_lock<std::mutex> collector(collecting, std::try_to_lock);
+  if (!collector)
+    return;
+  std::array<std::unique_lock<std::mutex>, shardCount> locks;
+  std::array<size_t, shardCount> remaining;
+  for (size_t index = 0; index < shardCount; ++index) {
+    locks[index] = std::unique_lock<std::mutex>(shards[index].mutex);
+    remaining[index] = shards[index].order.size();
+  }
+
+  // Newest first across all shards: a node is created after its operands,
+  // so dropping it first lets the operands only it held go in the same pass.
+  // A node held by the table alone cannot be picked up by another thread,
+  // which would have to find it in the table, so dropping it is safe.
+  size_t dropped = 0;
+  while (true) {
+    size_t newest = shardCount;
+    for (size_t index = 0; index < shardCount; ++index) {
+      if (remaining[index] == 0)
+        continue;
+      if (newest == shardCount ||
+          shards[index].order[remaining[index] - 1].first >
+              shards[newest].order[remaining[newest] - 1].first)
+        newest = index;
+    }
+    if (newest == shardCount)
+      break;
+    Shard &shard = shards[newest];
+    auto &[number, entry] = shard.order[--remaining[newest]];
+    NodeKind kind = entry->first.kind;
+    if (entry->second.use_count() != 1 || kind == NK_BoolSymbol ||
+        kind == NK_IntSymbol)
+      continue;
+    shard.nodes.erase(shard.nodes.find(entry->first));
+    entry = nullptr;
+    ++dropped;
+  }
+
+  for (Shard &shard : shards)
+    shard.order.erase(std::remove_if(shard.order.begin(), shard.order.end(),
+                                     [](const auto &slot) {
+                                       return slot.second == nullptr;
+                                     }),
+                      shard.order.end());
+  size_t kept =
+      interned.fetch_sub(dropped, std::memory_order_relaxed) - dropped;
+  collectAt.store(std::max(minCollectSize, 2 * kept),
+                  std::memory_order_relaxed);
+}
+
+size_t ExprFactory::size() const {
+  size_t total = 0;
+  for (const Shard &shard : shards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    total += shard.nodes.size();
+  }
+  return total;
+}
+
+size_t ExprFactory::bytesAllocated() const {
+  size_t total = 0;
+  for (const Shard &shard : shards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    total += shard.arena->bytesAllocated();
+  }
+  return total;
+}
+
+std::shared_ptr<BoolExpression> ExprFactory::boolConst(bool value) {
+  return intern<BoolConst, BoolExpression>(
+      Key::constant(NK_BoolConst, value), value);
+}
+
+std::shared_ptr<BoolExpression>
+ExprFactory::boolSymbol(const std::string &identifier) {
+  return boolSymbol(identifier, created.load(std::memory_order_relaxed));
+}
+
+std::shared_ptr<BoolExpression>
+ExprFactory::boolSymbol(const std::string &identifier, uint32_t id) {
+  return intern<BoolSymbol, BoolExpression>(
+      Key::symbol(NK_BoolSymbol, identifier), identifier, id);
+}
+
+std::shared_ptr<BoolExpression>
+ExprFactory::makeBoolNeg(std::shared_ptr<BoolExpression> subExpr) {
+  Key key = Key::operation(NK_BoolNeg, subExpr.get());
+  return intern<BoolNeg, BoolExpression>(std::move(key), std::move(subExpr));
+}
+
+std::shared_ptr<BoolExpression>
+ExprFactory::makeBoolAnd(std::shared_ptr<BoolExpression> lhs,
+                         std::shared_ptr<BoolExpression> rhs) {
+  Key key = Key::operation(NK_BoolAnd, lhs.get(), rhs.get());
+  return intern<BoolAnd, BoolExpression>(std::move(key), std::move(lhs),
+                                         std::move(rhs));
+}
+
+std::shared_ptr<BoolExpression>
+ExprFactory::makeBoolOr(std::shared_ptr<BoolExpression> lhs,
+                        std::shared_ptr<BoolExpression> rhs) {
+  Key key = Key::operation(NK_BoolOr, lhs.get(), rhs.get());
+  return intern<BoolOr, BoolExpression>(std::move(key), std::move(lhs),
+                                        std::move(rhs));
+}
+
+std::shared_ptr<BoolExpression>
+ExprFactory::makeIntLess(std::shared_ptr<IntExpression> lhs,
+                         std::shared_ptr<IntExpression> rhs) {
+  Key key = Key::operation(NK_IntLess, lhs.get(), rhs.get());
+  return intern<IntLess, BoolExpression>(std::move(key), std::move(lhs),
+                                         std::move(rhs));
+}
+
+std::shared_ptr<BoolExpression>
+ExprFactory::makeIntGreater(std::shared_ptr<IntExpression> lhs,
+                            std::shared_ptr<IntExpression> rhs) {
+  Key key = Key::operation(NK_IntGreater, lhs.get(), rhs.get());
+  return intern<IntGreater, BoolExpression>(std::move(key), std::move(lhs),
+                                            std::move(rhs));
+}
+
+std::shared_ptr<BoolExpression>
+ExprFactory::makeBoolIte(std::shared_ptr<BoolExpression> condition,
+                         std::shared_ptr<BoolExpression> thenExpr,
+                         std::shared_ptr<BoolExpression> elseExpr) {
+  Key key =
+      Key::ite(NK_BoolIte, condition.get(), thenExpr.get(), elseExpr.get());
+  return intern<BoolIte, BoolExpression>(std::move(key), std::move(condition),
+                                         std::move(thenExpr),
+                                         std::move(elseExpr));
+}
+
+std::shared_ptr<IntExpression>
+ExprFactory::makeIntIte(std::shared_ptr<BoolExpression> condition,
+                        std::shared_ptr<IntExpression> thenExpr,
+                        std::shared_ptr<IntExpression> elseExpr) {
+  Key key =
+      Key::ite(NK_IntIte, condition.get(), thenExpr.get(), elseExpr.get());
+  return intern<IntIte, IntExpression>(std::move(key), std::move(condition),
+                                       std::move(thenExpr),
+                                       std::move(elseExpr));
+}
+
+std::shared_ptr<IntExpression>
+ExprFactory::makeIntAdd(std::shared_ptr<IntExpression> lhs,
+                        std::shared_ptr<IntExpression> rhs) {
+  Key key = Key::operation(NK_IntAdd, lhs.get(), rhs.get());
+  return intern<IntAdd, IntExpression>(std::move(key), std::move(lhs),
+                                       std::move(rhs));
+}
+
+std::shared_ptr<IntExpression>
+ExprFactory::makeIntSub(std::shared_ptr<IntExpression> lhs,
+                        std::shared_ptr<IntExpression> rhs) {
+  Key key = Key::operation(NK_IntSub, lhs.get(), rhs.get());
+  return intern<IntSub, IntExpression>(std::move(key), std::move(lhs),
+                                       std::move(rhs));
+}
+
+std::shared_ptr<IntExpression> ExprFactory::intConst(int64_t value) {
+  return intern<IntConst, IntExpression>(
+      Key::constant(NK_IntConst, value), value);
+}
+
+std::shared_ptr<IntExpression>
+ExprFactory::intSymbol(const std::string &identifier) {
+  return intSymbol(identifier, created.load(std::memory_order_relaxed));
+}
+
+std::shared_ptr<IntExpression>
+ExprFactory::intSymbol(const std::string &identifier, uint32_t id) {
+  // the id of a symbol fixes its term order in LinearExpr
+  return intern<IntSymbol, IntExpression>(
+      Key::symbol(NK_IntSymbol, identifier), identifier, id);
+}
+
+namespace {
+
+// Wrapping int64 arithmetic, matching two's complement machine semantics.
+int64_t wrapAdd(int64_t lhs, int64_t rhs) {
+  return static_cast<int64_t>(static_cast<uint64_t>(lhs) +
+                              static_cast<uint64_t>(rhs));
+}
+
+int64_t wrapSub(int64_t lhs, int64_t rhs) {
+  return static_cast<int64_t>(static_cast<uint64_t>(lhs) -
+                              static_cast<uint64_t>(rhs));
+}
+
+const IntConst *asIntConst(const std::shared_ptr<IntExpression> &expr) {
+  return dynamic_cast<const IntConst *>(expr.get());
+}
+
+const BoolConst *asBoolConst(const std::shared_ptr<BoolExpression> &expr) {
+  return dynamic_cast<const BoolConst *>(expr.get());
+}
+
+bool isNegationOf(const std::shared_ptr<BoolExpression> &expr,
+                  const std::shared_ptr<BoolExpression> &other) {
+  auto *neg = dynamic_cast<const BoolNeg *>(expr.get());
+  return neg && neg->subExpr == other;
+}
+
+bool symbolLess(const IntSymbol &lhs, const IntSymbol &rhs) {
+  if (lhs.id != rhs.id)
+    return lhs.id < rhs.id;
+  return lhs.identifier < rhs.identifier;
+}
+
+bool sameSymbol(const IntSymbol &lhs, const IntSymbol &rhs) {
+  return &lhs == &rhs || (lhs.id == rhs.id && lhs.identifier == rhs.identifier);
+}
+
+struct LinearForm {
+  std::vector<LinearExpr::Term> terms;
+  int64_t constant = 0;
+};
+
+// lhs + sign * rhs, merging the sorted term lists and dropping zeros.
+LinearForm combine(const LinearForm &lhs, const LinearForm &rhs,
+                   bool subtract) {
+  LinearForm result;
+  result.terms.reserve(lhs.terms.size() + rhs.terms.size());
+  auto scaled = [subtract](int64_t coefficient) {
+    return subtract ? wrapSub(0, coefficient) : coefficient;
+  };
+  auto lhsIt = lhs.terms.begin();
+  auto rhsIt = rhs.terms.begin();
+  while (lhsIt != lhs.terms.end() || rhsIt != rhs.terms.end()) {
+    if (rhsIt == rhs.terms.end() ||
+        (lhsIt != lhs.terms.end() &&
+         symbolLess(*lhsIt->symbol, *rhsIt->symbol))) {
+      result.terms.push_back(*lhsIt++);
+    } else if (lhsIt == lhs.terms.end() ||
+               !sameSymbol(*lhsIt->symbol, *rhsIt->symbol)) {
+      result.terms.push_back({rhsIt->symbol, scaled(rhsIt->coefficient)});
+      ++rhsIt;
+    } else {
+      int64_t coefficient =
+          wrapAdd(lhsIt->coefficient, scaled(rhsIt->coefficient));
+      if (coefficient != 0)
+        result.terms.push_back({lhsIt->symbol, coefficient});
+      ++lhsIt;
+      ++rhsIt;
+    }
+  }
+  result.constant = subtract ? wrapSub(lhs.constant, rhs.constant)
+                             : wrapAdd(lhs.constant, rhs.constant);
+  return result;
+}
+
+// Collects the linear form of an operand without walking into it. The
+// factory only builds IntAdd and IntSub when an operand has no linear form,
+// so those fail like the ite they contain, and the expression is kept as an
+// opaque operand instead. Construction thus costs O(operand size) however
+// deep the operand is.
+class LinearCollector : public IExpressionsVisitor {
+public:
+  explicit LinearCollector(const std::shared_ptr<IntExpression> &expr)
+      : current(expr) {}
+
+  std::optional<LinearForm> collect() {
+    current->accept(*this);
+    if (!linear)
+      return std::nullopt;
+    return std::move(form);
+  }
+
+  void visitIntConst(const IntConst &expr) override {
+    form.constant = expr.value;
+  }
+  void visitIntSymbol(const IntSymbol &) override {
+    form.terms.push_back(
+        {std::static_pointer_cast<IntSymbol>(current), /*coefficient=*/1});
+  }
+  void visitLinearExpr(const LinearExpr &expr) override {
+    form.terms = expr.terms;
+    form.constant = expr.constant;
+  }
+  void visitIntAdd(const IntAdd &) override { linear = false; }
+  void visitIntSub(const IntSub &) override { linear = false; }
+  void visitIntIte(const IntIte &) override { linear = false; }
+
+private:
+
+  const std::shared_ptr<IntExpression> &current;
+  LinearForm form;
+  bool linear = true;
+};
+
+std::optional<LinearForm> toLinear(const std::shared_ptr<IntExpression> &expr) {
+  return LinearCollector(expr).collect();
+}
+
+} // namespace
+
+std::shared_ptr<IntExpression>
+ExprFactory::makeLinear(std::vector<LinearExpr::Term> terms, int64_t constant) {
+  if (terms.empty())
+    return intConst(constant);
+  if (terms.size() == 1 && terms.front().coefficient == 1 && constant == 0)
+    return terms.front().symbol;
+  Key key = Key::constant(NK_Linear, constant);
+  key.terms.reserve(terms.size());
+  for (const LinearExpr::Term &term : terms)
+    key.terms.emplace_back(term.symbol.get(), term.coefficient);
+  return intern<LinearExpr, IntExpression>(std::move(key), std::move(terms),
+                                           constant);
+}
+
+std::shared_ptr<IntExpression>
+ExprFactory::intAdd(std::shared_ptr<IntExpression> lhs,
+                    std::shared_ptr<IntExpression> rhs) {
+  auto lhsForm = toLinear(lhs);
+  auto rhsForm = toLinear(rhs);
+  if (!lhsForm || !rhsForm)
+    return makeIntAdd(std::move(lhs), std::move(rhs));
+  LinearForm form = combine(*lhsForm, *rhsForm, /*subtract=*/false);
+  return makeLinear(std::move(form.terms), form.constant);
+}
+
+std::shared_ptr<IntExpression>
+ExprFactory::intSub(std::shared_ptr<IntExpression> lhs,
+                    std::shared_ptr<IntExpression> rhs) {
+  auto lhsForm = toLinear(lhs);
+  auto rhsForm = toLinear(rhs);
+  if (!lhsForm || !rhsForm)
+    return makeIntSub(std::move(lhs), std::move(rhs));
+  LinearForm form = combine(*lhsForm, *rhsForm, /*subtract=*/true);
+  return makeLinear(std::move(form.terms), form.constant);
+}
+
+std::shared_ptr<BoolExpression>
+ExprFactory::intLess(std::shared_ptr<IntExpression> lhs,
+                     std::shared_ptr<IntExpression> rhs) {
+  auto *lhsConst = asIntConst(lhs);
+  auto *rhsConst = asIntConst(rhs);
+  if (lhsConst && rhsConst)
+    return boolConst(lhsConst->value < rhsConst->value);
+  if (lhs == rhs)
+    return boolConst(false);
+  return makeIntLess(std::move(lhs), std::move(rhs));
+}
+
+std::shared_ptr<BoolExpression>
+ExprFactory::intGreater(std::shared_ptr<IntExpression> lhs,
+                        std::shared_ptr<IntExpression> rhs) {
+  auto *lhsConst = asIntConst(lhs);
+  auto *rhsConst = asIntConst(rhs);
+  if (lhsConst && rhsConst)
+    return boolConst(lhsConst->value > rhsConst->value);
+  if (lhs == rhs)
+    return boolConst(false);
+  return makeIntGreater(std::move(lhs), std::move(rhs));
+}
+
+std::shared_ptr<BoolExpression>
+ExprFactory::boolNeg(std::shared_ptr<BoolExpression> subExpr) {
+  if (auto *constant = asBoolConst(subExpr))
+    return boolConst(!constant->value);
+  if (auto *neg = dynamic_cast<const BoolNeg *>(subExpr.get()))
+    return neg->subExpr;
+  return makeBoolNeg(std::move(subExpr));
+}
+
+std::shared_ptr<BoolExpression>
+ExprFactory::boolAnd(std::shared_ptr<BoolExpression> lhs,
+                     std::shared_ptr<BoolExpression> rhs) {
+  if (auto *constant = asBoolConst(lhs))
+    return constant->value ? rhs : lhs;
+  if (auto *constant = asBoolConst(rhs))
+    return constant->value ? lhs : rhs;
+  if (lhs == rhs)
+    return lhs;
+  if (isNegationOf(lhs, rhs) || isNegationOf(rhs, lhs))
+    return boolConst(false);
+  return makeBoolAnd(std::move(lhs), std::move(rhs));
+}
+
+std::shared_ptr<BoolExpression>
+ExprFactory::boolOr(std::shared_ptr<BoolExpression> lhs,
+                    std::shared_ptr<BoolExpression> rhs) {
+  if (auto *constant = asBoolConst(lhs))
+    return constant->value ? lhs : rhs;
+  if (auto *constant = asBoolConst(rhs))
+    return constant->value ? rhs : lhs;
+  if (lhs == rhs)
+    return lhs;
+  if (isNegationOf(lhs, rhs) || isNegationOf(rhs, lhs))
+    return boolConst(true);
+  return makeBoolOr(std::move(lhs), std::move(rhs));
+}
+
+std::shared_ptr<BoolExpression>
+ExprFactory::boolIte(std::shared_ptr<BoolExpression> condition,
+                     std::shared_ptr<BoolExpression> thenExpr,
+                     std::shared_ptr<BoolExpression> elseExpr) {
+  if (auto *constant = asBoolConst(condition))
+    return constant->value ? thenExpr : elseExpr;
+  if (thenExpr == elseExpr)
+    return thenExpr;
+  // a constant branch turns the ite into a plain connective
+  if (auto *constant = asBoolConst(thenExpr))
+    return constant->value ? boolOr(condition, elseExpr)
+                           : boolAnd(boolNeg(condition), elseExpr);
+  if (auto *constant = asBoolConst(elseExpr))
+    return constant->value ? boolOr(boolNeg(condition), thenExpr)
+                           : boolAnd(condition, thenExpr);
+  if (auto *neg = dynamic_cast<const BoolNeg *>(condition.get()))
+    return boolIte(neg->subExpr, std::move(elseExpr), std::move(thenExpr));
+  if (auto *inner = dynamic_cast<const BoolIte *>(thenExpr.get()))
+    if (inner->condition == condition)
+      return boolIte(condition, inner->thenExpr, std::move(elseExpr));
+  if (auto *inner = dynamic_cast<const BoolIte *>(elseExpr.get()))
+    if (inner->condition == condition)
+      return boolIte(condition, std::move(thenExpr), inner->elseExpr);
+  return makeBoolIte(std::move(condition), std::move(thenExpr),
+                     std::move(elseExpr));
+}
+
+std::shared_ptr<IntExpression>
+ExprFactory::intIte(std::shared_ptr<BoolExpression> condition,
+                    std::shared_ptr<IntExpression> thenExpr,
+                    std::shared_ptr<IntExpression> elseExpr) {
+  if (auto *constant = asBoolConst(condition))
+    return constant->value ? thenExpr : elseExpr;
+  if (thenExpr == elseExpr)
+    return thenExpr;
+  if (auto *neg = dynamic_cast<const BoolNeg *>(condition.get()))
+    return intIte(neg->subExpr, std::move(elseExpr), std::move(thenExpr));
+  if (auto *inner = dynamic_cast<const IntIte *>(thenExpr.get()))
+    if (inner->condition == condition)
+      return intIte(condition, inner->thenExpr, std::move(elseExpr));
+  if (auto *inner = dynamic_cast<const IntIte *>(elseExpr.get()))
+    if (inner->condition == condition)
+      return intIte(condition, std::move(thenExpr), inner->elseExpr);
+  return makeIntIte(std::move(condition), std::move(thenExpr),
+                    std::move(elseExpr));
+}
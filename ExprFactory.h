@@ -0,0 +1,277 @@
+#pragma once
+
+#include "Expressions.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mysym {
+
+// Bump allocator owning the memory of the nodes created by one shard of an
+// ExprFactory. Chunks are only released together with the arena, but a freed
+// block is kept in a list of blocks of its size and handed out again, so a
+// shard whose nodes keep being dropped stops growing. Nodes die on whatever
+// thread drops them last, so the arena has a lock of its own.
+class ExprArena {
+public:
+  explicit ExprArena(size_t chunkSize = 64 * 1024) : chunkSize(chunkSize) {}
+  ExprArena(const ExprArena &) = delete;
+  ExprArena &operator=(const ExprArena &) = delete;
+
+  void *allocate(size_t size, size_t alignment);
+  void deallocate(void *block, size_t size);
+
+  // bytes in blocks handed out and not freed
+  size_t bytesAllocated() const;
+
+private:
+  struct FreeBlock {
+    FreeBlock *next;
+  };
+
+  std::vector<std::unique_ptr<char[]>> chunks;
+  char *cursor = nullptr;
+  char *end = nullptr;
+  size_t chunkSize;
+  size_t allocated = 0;
+  // the freed blocks of every size, few as nodes come in a few sizes
+  std::vector<std::pair<size_t, FreeBlock *>> freeBlocks;
+  mutable std::mutex mutex;
+};
+
+// Allocator handed to std::allocate_shared: the node and its control block
+// live in the arena, and the copy of the allocator kept in the control block
+// keeps the arena alive. A node is therefore valid for as long as it is held,
+// whether or not its factory still exists.
+template <typename T> class ArenaAllocator {
+public:
+  using value_type = T;
+
+  explicit ArenaAllocator(std::shared_ptr<ExprArena> arena)
+      : arena(std::move(arena)) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+  T *allocate(size_t count) {
+    return static_cast<T *>(arena->allocate(count * sizeof(T), alignof(T)));
+  }
+  void deallocate(T *block, size_t count) {
+    arena->deallocate(block, count * sizeof(T));
+  }
+
+  template <typename U> bool operator==(const ArenaAllocator<U> &other) const {
+    return arena == other.arena;
+  }
+  template <typename U> bool operator!=(const ArenaAllocator<U> &other) const {
+    return arena != other.arena;
+  }
+
+private:
+  template <typename U> friend class ArenaAllocator;
+  std::shared_ptr<ExprArena> arena;
+};
+
+// Hash-consing constructor for symbolic expressions. Every node is interned
+// by (kind, children, value), so structurally equal expressions built through
+// the same factory are the same object and can be compared by pointer.
+// Nodes are allocated from ExprArenas that each node keeps alive, so nodes
+// may outlive the factory.
+//
+// Whenever the intern table has doubled since the last collection, the nodes
+// that nothing but the table holds are dropped and their memory is reused;
+// symbols stay, so that they keep their ids. Memory therefore follows the
+// nodes still referred to, by states being explored, results not yet
+// written and caches, rather than every node built so far. The factory may
+// be used from several threads at once: the intern table is split into
+// shards by key hash, each with its own lock and arena, so threads only
+// contend when they build nodes that land in the same shard, or while a
+// collection holds every shard.
+//
+// Construction also simplifies: constants are folded, boolean identities
+// (!!b, b & true, b | !b, ...) are applied, and integer arithmetic is kept in
+// canonical LinearExpr form, so equivalent values intern to the same node.
+// Ites with a constant condition or equal branches collapse, a negated
+// condition swaps the branches, and a branch repeating the ite's condition is
+// resolved; boolean ites with a constant branch become & or |. Arithmetic
+// involving an IntIte cannot be put in linear form and
+// is kept as plain IntAdd and IntSub nodes.
+class ExprFactory {
+public:
+  ExprFactory() = default;
+  ExprFactory(const ExprFactory &) = delete;
+  ExprFactory &operator=(const ExprFactory &) = delete;
+
+  std::shared_ptr<BoolExpression> boolConst(bool value);
+  // Symbols are interned by identifier and keep the id they were first
+  // created with; ids order the terms of LinearExpr and default to creation
+  // order.
+  std::shared_ptr<BoolExpression> boolSymbol(const std::string &identifier);
+  std::shared_ptr<BoolExpression> boolSymbol(const std::string &identifier,
+                                             uint32_t id);
+  std::shared_ptr<BoolExpression>
+  boolNeg(std::shared_ptr<BoolExpression> subExpr);
+  std::shared_ptr<BoolExpression> boolAnd(std::shared_ptr<BoolExpression> lhs,
+                                          std::shared_ptr<BoolExpression> rhs);
+  std::shared_ptr<BoolExpression> boolOr(std::shared_ptr<BoolExpression> lhs,
+                                         std::shared_ptr<BoolExpression> rhs);
+  std::shared_ptr<BoolExpression> intLess(std::shared_ptr<IntExpression> lhs,
+                                          std::shared_ptr<IntExpression> rhs);
+  std::shared_ptr<BoolExpression>
+  intGreater(std::shared_ptr<IntExpression> lhs,
+             std::shared_ptr<IntExpression> rhs);
+  std::shared_ptr<BoolExpression>
+  boolIte(std::shared_ptr<BoolExpression> condition,
+          std::shared_ptr<BoolExpression> thenExpr,
+          std::shared_ptr<BoolExpression> elseExpr);
+
+  std::shared_ptr<IntExpression> intConst(int64_t value);
+  std::shared_ptr<IntExpression> intSymbol(const std::string &identifier);
+  std::shared_ptr<IntExpression> intSymbol(const std::string &identifier,
+                                           uint32_t id);
+  std::shared_ptr<IntExpression> intAdd(std::shared_ptr<IntExpression> lhs,
+                                        std::shared_ptr<IntExpression> rhs);
+  std::shared_ptr<IntExpression> intSub(std::shared_ptr<IntExpression> lhs,
+                                        std::shared_ptr<IntExpression> rhs);
+  std::shared_ptr<IntExpression>
+  intIte(std::shared_ptr<BoolExpression> condition,
+         std::shared_ptr<IntExpression> thenExpr,
+         std::shared_ptr<IntExpression> elseExpr);
+
+  size_t size() const;
+  size_t bytesAllocated() const;
+
+private:
+  enum NodeKind {
+    NK_BoolConst,
+    NK_BoolSymbol,
+    NK_BoolNeg,
+    NK_BoolAnd,
+    NK_BoolOr,
+    NK_BoolIte,
+    NK_IntLess,
+    NK_IntGreater,
+    NK_IntConst,
+    NK_IntSymbol,
+    NK_IntAdd,
+    NK_IntSub,
+    NK_Linear,
+    NK_IntIte,
+  };
+
+  struct Key {
+    explicit Key(NodeKind kind) : kind(kind) {}
+
+    static Key constant(NodeKind kind, int64_t value) {
+      Key key(kind);
+      key.value = value;
+      return key;
+    }
+    static Key symbol(NodeKind kind, std::string identifier) {
+      Key key(kind);
+      key.identifier = std::move(identifier);
+      return key;
+    }
+    static Key operation(NodeKind kind, const Expressions *lhs,
+                         const Expressions *rhs = nullptr) {
+      Key key(kind);
+      key.lhs = lhs;
+      key.rhs = rhs;
+      return key;
+    }
+    static Key ite(NodeKind kind, const Expressions *condition,
+                   const Expressions *thenExpr, const Expressions *elseExpr) {
+      Key key = operation(kind, thenExpr, elseExpr);
+      key.condition = condition;
+      return key;
+    }
+
+    NodeKind kind;
+    const Expressions *condition = nullptr;
+    const Expressions *lhs = nullptr;
+    const Expressions *rhs = nullptr;
+    int64_t value = 0;
+    std::string identifier;
+    std::vector<std::pair<const Expressions *, int64_t>> terms;
+
+    bool operator==(const Key &other) const {
+      return kind == other.kind && condition == other.condition &&
+             lhs == other.lhs && rhs == other.rhs &&
+             value == other.value && identifier == other.identifier &&
+             terms == other.terms;
+    }
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key &key) const;
+  };
+
+  template <typename T, typename Result, typename... Args>
+  std::shared_ptr<Result> intern(Key key, Args &&...args);
+  // Drops the nodes only the intern table holds. Skipped if another thread
+  // is already collecting.
+  void collect();
+
+  std::shared_ptr<BoolExpression>
+  makeBoolNeg(std::shared_ptr<BoolExpression> subExpr);
+  std::shared_ptr<BoolExpression>
+  makeBoolAnd(std::shared_ptr<BoolExpression> lhs,
+              std::shared_ptr<BoolExpression> rhs);
+  std::shared_ptr<BoolExpression>
+  makeBoolOr(std::shared_ptr<BoolExpression> lhs,
+             std::shared_ptr<BoolExpression> rhs);
+  std::shared_ptr<BoolExpression>
+  makeIntLess(std::shared_ptr<IntExpression> lhs,
+              std::shared_ptr<IntExpression> rhs);
+  std::shared_ptr<BoolExpression>
+  makeIntGreater(std::shared_ptr<IntExpression> lhs,
+                 std::shared_ptr<IntExpression> rhs);
+
+  std::shared_ptr<BoolExpression>
+  makeBoolIte(std::shared_ptr<BoolExpression> condition,
+              std::shared_ptr<BoolExpression> thenExpr,
+              std::shared_ptr<BoolExpression> elseExpr);
+  std::shared_ptr<IntExpression>
+  makeIntIte(std::shared_ptr<BoolExpression> condition,
+             std::shared_ptr<IntExpression> thenExpr,
+             std::shared_ptr<IntExpression> elseExpr);
+
+  std::shared_ptr<IntExpression> makeIntAdd(std::shared_ptr<IntExpression> lhs,
+                                            std::shared_ptr<IntExpression> rhs);
+  std::shared_ptr<IntExpression> makeIntSub(std::shared_ptr<IntExpression> lhs,
+                                            std::shared_ptr<IntExpression> rhs);
+  std::shared_ptr<IntExpression>
+  makeLinear(std::vector<LinearExpr::Term> terms, int64_t constant);
+
+private:
+  static constexpr size_t shardCount = 16;
+  // nodes held before the first collection
+  static constexpr size_t minCollectSize = 16 * 1024;
+
+  struct Shard {
+    using Nodes =
+        std::unordered_map<Key, std::shared_ptr<Expressions>, KeyHash>;
+    Nodes nodes;
+    // the entries of nodes by creation, with their sequence numbers
+    std::vector<std::pair<uint64_t, Nodes::value_type *>> order;
+    std::shared_ptr<ExprArena> arena = std::make_shared<ExprArena>();
+    // guards nodes and order
+    mutable std::mutex mutex;
+  };
+
+  std::array<Shard, shardCount> shards;
+  // nodes created so far, the default id of a new symbol
+  std::atomic<uint32_t> created{0};
+  // orders the creation of nodes across shards
+  std::atomic<uint64_t> sequence{0};
+  // entries in the intern table, and the number starting a collection
+  std::atomic<size_t> interned{0};
+  std::atomic<size_t> collectAt{minCollectSize};
+  std::mutex collecting;
+};
+
+} // namespace mysym
@@ -1,5 +1,6 @@
 #include "Expressions.h"
-#include <sstream>
+#include "ExprFactory.h"
+#include "Renderer.h"
 
 using namespace mysym;
 
@@ -8,46 +9,57 @@ std::string Expressions::save_minimal(const cereal::JSONOutputArchive &) const {
 }
 
 std::shared_ptr<BoolExpression> mysym::conjunction(
+    ExprFactory &factory,
     const std::vector<std::shared_ptr<BoolExpression>> &expressions) {
     if (expressions.empty())
-        return std::make_shared<BoolConst>(true);
+        return factory.boolConst(true);
     std::shared_ptr<BoolExpression> current = expressions.front();
     for (size_t index = 1; index < expressions.size(); ++index)
-        current = std::make_shared<BoolAnd>(current, expressions[index]);
+        current = factory.boolAnd(current, expressions[index]);
     return current;
 }
 
 namespace {
 
-class RecursiveRenderer : public IExpressionsVisitor {
+class OperandCollector : public IExpressionsVisitor {
 public:
-    void render(const Expressions &expr) {
-        expr.accept(*this);
-    }
-
-    std::string getString() const { return oss.str(); }
+    explicit OperandCollector(std::vector<std::shared_ptr<Expressions>> &operands)
+        : operands(operands) {}
 
-    void visitBoolConst(const BoolConst &expr) override { oss << (expr.value ? "true" : "false"); }
-    void visitBoolSymbol(const BoolSymbol &expr) override { oss << expr.identifier; }
-    void visitBoolNeg(const BoolNeg &expr) override { oss << '!'; render(*expr.subExpr); }
-    void visitBoolAnd(const BoolAnd &expr) override { oss << '('; render(*expr.lhs); oss << " & "; render(*expr.rhs); oss << ')'; }
-    void visitBoolOr(const BoolOr &expr) override { oss << '('; render(*expr.lhs); oss << " | "; render(*expr.rhs); oss << ')'; }
-
-    void visitIntLess(const IntLess &expr) override { oss << '('; render(*expr.lhs); oss << " < "; render(*expr.rhs); oss << ')'; }
-    void visitIntGreater(const IntGreater &expr) override { oss << '('; render(*expr.lhs); oss << " > "; render(*expr.rhs); oss << ')'; }
-    void visitIntConst(const IntConst &expr) override { oss << expr.value; }
-    void visitIntSymbol(const IntSymbol &expr) override { oss << expr.identifier; }
-    void visitIntAdd(const IntAdd &expr) override { oss << '('; render(*expr.lhs); oss << " + "; render(*expr.rhs); oss << ')'; }
-    void visitIntSub(const IntSub &expr) override { oss << '('; render(*expr.lhs); oss << " - "; render(*expr.rhs); oss << ')'; }
+    void visitBoolNeg(const BoolNeg &expr) override { add(expr.subExpr); }
+    void visitBoolAnd(const BoolAnd &expr) override { add(expr.lhs, expr.rhs); }
+    void visitBoolOr(const BoolOr &expr) override { add(expr.lhs, expr.rhs); }
+    void visitBoolIte(const BoolIte &expr) override { add(expr.condition, expr.thenExpr, expr.elseExpr); }
+    void visitIntLess(const IntLess &expr) override { add(expr.lhs, expr.rhs); }
+    void visitIntGreater(const IntGreater &expr) override { add(expr.lhs, expr.rhs); }
+    void visitIntAdd(const IntAdd &expr) override { add(expr.lhs, expr.rhs); }
+    void visitIntSub(const IntSub &expr) override { add(expr.lhs, expr.rhs); }
+    void visitIntIte(const IntIte &expr) override { add(expr.condition, expr.thenExpr, expr.elseExpr); }
+    void visitLinearExpr(const LinearExpr &expr) override {
+        for (const LinearExpr::Term &term : expr.terms)
+            add(term.symbol);
+    }
 
 private:
-    std::ostringstream oss;
+    template <typename... T> void add(const std::shared_ptr<T> &...operand) {
+        (operands.push_back(operand), ...);
+    }
+
+    std::vector<std::shared_ptr<Expressions>> &operands;
 };
 
 } 
 
-std::string mysym::render(const Expressions &expr) {
-    RecursiveRenderer renderer;
-    renderer.render(expr);
-    return renderer.getString();
+void mysym::collectOperands(const Expressions &expr,
+                            std::vector<std::shared_ptr<Expressions>> &operands) {
+    OperandCollector collector(operands);
+    expr.accept(collector);
+}
+
+std::string mysym::render(const Expressions &expr, ExpressionStyle style) {
+    thread_local Renderer renderer;
+    thread_local fmt::memory_buffer buffer;
+    buffer.clear();
+    renderer.render(expr, buffer, style);
+    return fmt::to_string(buffer);
 }
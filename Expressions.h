@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
@@ -10,6 +11,8 @@ class JSONOutputArchive;
 
 namespace mysym {
 
+class ExprFactory;
+
 class IExpressionsVisitor {
 public:
   virtual void visitBoolConst(const class BoolConst &expr) {}
@@ -17,12 +20,15 @@ public:
   virtual void visitBoolNeg(const class BoolNeg &expr) {}
   virtual void visitBoolAnd(const class BoolAnd &expr) {}
   virtual void visitBoolOr(const class BoolOr &expr) {}
+  virtual void visitBoolIte(const class BoolIte &expr) {}
   virtual void visitIntLess(const class IntLess &expr) {}
   virtual void visitIntGreater(const class IntGreater &expr) {}
   virtual void visitIntConst(const class IntConst &expr) {}
   virtual void visitIntSymbol(const class IntSymbol &expr) {}
   virtual void visitIntAdd(const class IntAdd &expr) {}
   virtual void visitIntSub(const class IntSub &expr) {}
+  virtual void visitLinearExpr(const class LinearExpr &expr) {}
+  virtual void visitIntIte(const class IntIte &expr) {}
 };
 
 struct Expressions {
@@ -46,7 +52,9 @@ struct BoolConst final : BoolExpression {
 
 struct BoolSymbol final : BoolExpression {
   std::string identifier;
-  explicit BoolSymbol(const std::string &identifier) : identifier(identifier) {}
+  uint32_t id;
+  explicit BoolSymbol(const std::string &identifier, uint32_t id = 0)
+      : identifier(identifier), id(id) {}
   DEFINE_ACCEPT(BoolSymbol, visitBoolSymbol)
 };
 
@@ -71,6 +79,17 @@ struct BoolOr final : BoolExpression {
   DEFINE_ACCEPT(BoolOr, visitBoolOr)
 };
 
+// condition ? thenExpr : elseExpr; built by state merging
+struct BoolIte final : BoolExpression {
+  std::shared_ptr<BoolExpression> condition, thenExpr, elseExpr;
+  BoolIte(std::shared_ptr<BoolExpression> condition,
+          std::shared_ptr<BoolExpression> thenExpr,
+          std::shared_ptr<BoolExpression> elseExpr)
+      : condition(std::move(condition)), thenExpr(std::move(thenExpr)),
+        elseExpr(std::move(elseExpr)) {}
+  DEFINE_ACCEPT(BoolIte, visitBoolIte)
+};
+
 struct IntLess final : BoolExpression {
   std::shared_ptr<IntExpression> lhs, rhs;
   IntLess(std::shared_ptr<IntExpression> lhs, std::shared_ptr<IntExpression> rhs) 
@@ -93,7 +112,9 @@ struct IntConst final : IntExpression {
 
 struct IntSymbol final : IntExpression {
   std::string identifier;
-  explicit IntSymbol(const std::string &identifier) : identifier(identifier) {}
+  uint32_t id;
+  explicit IntSymbol(const std::string &identifier, uint32_t id = 0)
+      : identifier(identifier), id(id) {}
   DEFINE_ACCEPT(IntSymbol, visitIntSymbol)
 };
 
@@ -111,9 +132,47 @@ struct IntSub final : IntExpression {
   DEFINE_ACCEPT(IntSub, visitIntSub)
 };
 
+// Affine combination sum(coefficient * symbol) + constant. Terms are sorted
+// by symbol id and have non-zero coefficients.
+struct LinearExpr final : IntExpression {
+  struct Term {
+    std::shared_ptr<IntSymbol> symbol;
+    int64_t coefficient;
+  };
+  std::vector<Term> terms;
+  int64_t constant;
+  LinearExpr(std::vector<Term> terms, int64_t constant)
+      : terms(std::move(terms)), constant(constant) {}
+  DEFINE_ACCEPT(LinearExpr, visitLinearExpr)
+};
+
+// condition ? thenExpr : elseExpr; built by state merging
+struct IntIte final : IntExpression {
+  std::shared_ptr<BoolExpression> condition;
+  std::shared_ptr<IntExpression> thenExpr, elseExpr;
+  IntIte(std::shared_ptr<BoolExpression> condition,
+         std::shared_ptr<IntExpression> thenExpr,
+         std::shared_ptr<IntExpression> elseExpr)
+      : condition(std::move(condition)), thenExpr(std::move(thenExpr)),
+        elseExpr(std::move(elseExpr)) {}
+  DEFINE_ACCEPT(IntIte, visitIntIte)
+};
+
 #undef DEFINE_ACCEPT  
 
-std::shared_ptr<BoolExpression> conjunction(const std::vector<std::shared_ptr<BoolExpression>> &expressions);
-std::string render(const Expressions &expr);
+std::shared_ptr<BoolExpression> conjunction(ExprFactory &factory, const std::vector<std::shared_ptr<BoolExpression>> &expressions);
+// How render() writes a subexpression occurring more than once.
+enum ExpressionStyle {
+  // in full at every occurrence
+  ES_Tree,
+  // once, bound to a name before the expression, as Renderer describes
+  ES_Shared,
+};
+
+std::string render(const Expressions &expr, ExpressionStyle style = ES_Tree);
+// Appends the operands of expr: the subexpressions its constructor takes, and
+// the symbols of the terms of a LinearExpr.
+void collectOperands(const Expressions &expr,
+                     std::vector<std::shared_ptr<Expressions>> &operands);
 
 } 
\ No newline at end of file
@@ -1,72 +1,241 @@
 #include "Interpreter.h"
 #include "AST.h"
+#include "ExprFactory.h"
 #include "cereal/archives/json.hpp"
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#ifdef __linux__
+#include <unistd.h>
+#endif
 
 using namespace mysym;
 
+// Operand types are checked by ASTBuilder, so symbolic operands are
+// downcast statically.
+static std::shared_ptr<IntExpression> asInt(std::shared_ptr<Expressions> expr) {
+  return std::static_pointer_cast<IntExpression>(std::move(expr));
+}
+
+static std::shared_ptr<BoolExpression>
+asBool(std::shared_ptr<Expressions> expr) {
+  return std::static_pointer_cast<BoolExpression>(std::move(expr));
+}
+
+static std::shared_ptr<Expressions> processExpr(const Expression &expression,
+                                                const SymbolicMemory &memory,
+                                                ExprFactory &factory) {
+  switch (expression.exprKind) {
+  case EK_VarRef: {
+    auto &varRef = static_cast<const VarRef &>(expression);
+    return memory.get(varRef.slot);
+  }
+  case EK_IntConstant: {
+    auto &intConst = static_cast<const IntConstant &>(expression);
+    return factory.intConst(intConst.value);
+  }
+  case EK_BoolConstant: {
+    auto &boolConst = static_cast<const BoolConstant &>(expression);
+    return factory.boolConst(boolConst.value);
+  }
+  case EK_UnOp: {
+    auto &unop = static_cast<const UnOp &>(expression);
+    assert(unop.kind == UO_Neg);
+    return factory.boolNeg(
+        asBool(processExpr(*unop.subExpr, memory, factory)));
+  }
+  case EK_BinOp: {
+    auto &binop = static_cast<const BinOp &>(expression);
+    auto lhs = processExpr(*binop.lhs, memory, factory);
+    auto rhs = processExpr(*binop.rhs, memory, factory);
+    switch (binop.kind) {
+    case BO_Add:
+      return factory.intAdd(asInt(std::move(lhs)), asInt(std::move(rhs)));
+    case BO_Sub:
+      return factory.intSub(asInt(std::move(lhs)), asInt(std::move(rhs)));
+    case BO_Lt:
+      return factory.intLess(asInt(std::move(lhs)), asInt(std::move(rhs)));
+    case BO_Gt:
+      return factory.intGreater(asInt(std::move(lhs)), asInt(std::move(rhs)));
+    case BO_LAnd:
+      return factory.boolAnd(asBool(std::move(lhs)), asBool(std::move(rhs)));
+    case BO_LOr:
+      return factory.boolOr(asBool(std::move(lhs)), asBool(std::move(rhs)));
+    }
+    throw std::runtime_error("wrong expression");
+  }
+  case EK_Error:
+    break;
+  }
+  throw std::runtime_error("wrong expression");
+}
+
 static std::shared_ptr<Expressions>
-processExpr(std::shared_ptr<const Expression> expression,
-         const SymbolicMemory &memory) {
-  if (auto *varRef = dynamic_cast<const VarRef *>(expression.get()))
-    return memory.get(varRef->identifier);
-  if (auto *intConst = dynamic_cast<const IntConstant *>(expression.get()))
-    return std::make_shared<IntConst>(intConst->value);
-  if (auto *boolConst = dynamic_cast<const BoolConstant *>(expression.get()))
-    return std::make_shared<BoolConst>(boolConst->value);
-  if (auto *unop = dynamic_cast<const UnOp *>(expression.get())) {
-    assert(unop->kind == UO_Neg);
-    auto subExpr =
-        std::dynamic_pointer_cast<BoolExpression>(processExpr(unop->subExpr, memory));
-    assert(subExpr);
-    return std::make_shared<BoolNeg>(std::move(subExpr));
-  }
-  if (auto *binop = dynamic_cast<const BinOp *>(expression.get())) {
-    auto lhs = processExpr(binop->lhs, memory);
-    auto rhs = processExpr(binop->rhs, memory);
-    switch (binop->kind) {
-    case BO_Add: {
-      return std::make_shared<IntAdd>(
-          std::dynamic_pointer_cast<IntExpression>(lhs),
-          std::dynamic_pointer_cast<IntExpression>(rhs));
-    }
-    case BO_Sub: {
-      return std::make_shared<IntSub>(
-          std::dynamic_pointer_cast<IntExpression>(lhs),
-          std::dynamic_pointer_cast<IntExpression>(rhs));
-    }
-    case BO_Lt: {
-      return std::make_shared<IntLess>(
-          std::dynamic_pointer_cast<IntExpression>(lhs),
-          std::dynamic_pointer_cast<IntExpression>(rhs));
-    }
-    case BO_Gt: {
-      return std::make_shared<IntGreater>(
-          std::dynamic_pointer_cast<IntExpression>(lhs),
-          std::dynamic_pointer_cast<IntExpression>(rhs));
-    }
-    case BO_LAnd: {
-      return std::make_shared<BoolAnd>(
-          std::dynamic_pointer_cast<BoolExpression>(lhs),
-          std::dynamic_pointer_cast<BoolExpression>(rhs));
-    }
-    case BO_LOr: {
-      return std::make_shared<BoolOr>(
-          std::dynamic_pointer_cast<BoolExpression>(lhs),
-          std::dynamic_pointer_cast<BoolExpression>(rhs));
-    }
-    default: {
+processFlatExpr(const FlatCode &code, FlatRange range,
+                const SymbolicMemory &memory, ExprFactory &factory,
+                std::vector<std::shared_ptr<Expressions>> &values) {
+  values.resize(range.end - range.begin);
+  auto operand = [&](uint32_t index) -> std::shared_ptr<Expressions> & {
+    return values[index - range.begin];
+  };
+  for (uint32_t index = range.begin; index < range.end; ++index) {
+    const FlatNode &node = code.nodes[index];
+    std::shared_ptr<Expressions> &value = operand(index);
+    switch (node.opcode) {
+    case FO_VarRef:
+      value = memory.get(static_cast<size_t>(node.value));
+      break;
+    case FO_IntConstant:
+      value = factory.intConst(node.value);
+      break;
+    case FO_BoolConstant:
+      value = factory.boolConst(node.value != 0);
+      break;
+    case FO_Neg:
+      value = factory.boolNeg(asBool(operand(node.lhs)));
+      break;
+    case FO_Add:
+      value = factory.intAdd(asInt(operand(node.lhs)),
+                             asInt(operand(node.rhs)));
+      break;
+    case FO_Sub:
+      value = factory.intSub(asInt(operand(node.lhs)),
+                             asInt(operand(node.rhs)));
+      break;
+    case FO_Lt:
+      value = factory.intLess(asInt(operand(node.lhs)),
+                              asInt(operand(node.rhs)));
+      break;
+    case FO_Gt:
+      value = factory.intGreater(asInt(operand(node.lhs)),
+                                 asInt(operand(node.rhs)));
+      break;
+    case FO_LAnd:
+      value = factory.boolAnd(asBool(operand(node.lhs)),
+                              asBool(operand(node.rhs)));
+      break;
+    case FO_LOr:
+      value = factory.boolOr(asBool(operand(node.lhs)),
+                             asBool(operand(node.rhs)));
+      break;
+    case FO_Error:
       throw std::runtime_error("wrong expression");
     }
-    }
   }
-  throw std::runtime_error("wrong expression");
+  std::shared_ptr<Expressions> result = std::move(values.back());
+  values.clear();
+  return result;
 }
 
+namespace {
+
+// The handler interface writeFields() expects, over a cereal archive whose
+// current node is the object of the result.
+class ArchiveJson {
+public:
+  explicit ArchiveJson(cereal::JSONOutputArchive &out) : out(out) {}
+
+  // names are the literals of writeFields(), so they outlive the archive's
+  // use of them
+  bool Key(const char *name, unsigned /*length*/) {
+    out.setNextName(name);
+    return true;
+  }
+  bool String(const char *text, unsigned length, bool /*copy*/) {
+    out(std::string(text, length));
+    return true;
+  }
+  bool StartObject() {
+    out.startNode();
+    return true;
+  }
+  bool EndObject() {
+    out.finishNode();
+    return true;
+  }
+  bool StartArray() {
+    out.startNode();
+    out.makeArray();
+    return true;
+  }
+  bool EndArray() {
+    out.finishNode();
+    return true;
+  }
+
+private:
+  cereal::JSONOutputArchive &out;
+};
+
+} // namespace
+
 void SymbolicExecutionResult::save(cereal::JSONOutputArchive &out) const {
-  out(cereal::make_nvp("values", memory),
-      cereal::make_nvp("pc", *pc),
-      cereal::make_nvp("result", *result));
+  ArchiveJson json(out);
+  writeFields(json, ES_Tree);
+}
+
+PathCondition
+PathCondition::extend(ExprFactory &factory,
+                      std::shared_ptr<BoolExpression> condition) const {
+  PathCondition extended;
+  auto conjunction =
+      head ? factory.boolAnd(head->conjunction, condition) : condition;
+  extended.head = std::make_shared<const Node>(
+      Node{head, std::move(condition), std::move(conjunction), size() + 1});
+  return extended;
+}
+
+std::shared_ptr<BoolExpression>
+PathCondition::conjunction(ExprFactory &factory) const {
+  return head ? head->conjunction : factory.boolConst(true);
+}
+
+std::vector<std::shared_ptr<BoolExpression>> PathCondition::conjuncts() const {
+  return conjunctsSince(PathCondition());
+}
+
+std::vector<std::shared_ptr<BoolExpression>>
+PathCondition::conjunctsSince(const PathCondition &prefix) const {
+  assert(prefix.size() <= size());
+  std::vector<std::shared_ptr<BoolExpression>> result(size() - prefix.size());
+  const Node *node = head.get();
+  for (auto it = result.rbegin(); it != result.rend(); ++it) {
+    *it = node->condition;
+    node = node->parent.get();
+  }
+  assert(node == prefix.head.get());
+  return result;
+}
+
+// Marks the parameters expression reads.
+static void markReads(const Expression &expression, std::vector<bool> &slots) {
+  switch (expression.exprKind) {
+  case EK_VarRef:
+    slots[static_cast<const VarRef &>(expression).slot] = true;
+    break;
+  case EK_UnOp:
+    markReads(*static_cast<const UnOp &>(expression).subExpr, slots);
+    break;
+  case EK_BinOp: {
+    auto &binop = static_cast<const BinOp &>(expression);
+    markReads(*binop.lhs, slots);
+    markReads(*binop.rhs, slots);
+    break;
+  }
+  case EK_IntConstant:
+  case EK_BoolConstant:
+  case EK_Error:
+    break;
+  }
 }
 
 namespace {
@@ -74,90 +243,853 @@ namespace {
 struct State {
   std::shared_ptr<Function> function;
   SymbolicMemory memory;
-  std::vector<std::shared_ptr<BoolExpression>> pc;
+  PathCondition pc;
+  std::shared_ptr<const IFeasibilityChecker::Context> feasibility;
+  // false for then, true for else at every branch taken so far; only kept
+  // when results are ordered deterministically
+  std::vector<bool> decisions;
+  // forks on the path so far
+  unsigned depth = 0;
+  // For coverage-guided search, the counter of the branch the state was
+  // forked into; it is counted once the state resumes.
+  std::atomic<uint32_t> *branchHits = nullptr;
+
+  void countBranch() {
+    if (branchHits)
+      ++*branchHits;
+    branchHits = nullptr;
+  }
 
-  std::vector<std::shared_ptr<Statement>> statementStack;
+  // Continuation: the block being executed and the position in it, plus the
+  // frames of the enclosing blocks to resume afterwards. Frames never change
+  // once pushed, so forks share them and forking costs the same however
+  // much of the program is left.
+  struct Frame {
+    const std::vector<std::shared_ptr<Statement>> *block;
+    size_t index;
+    std::shared_ptr<const Frame> parent;
+  };
+  const std::vector<std::shared_ptr<Statement>> *block;
+  size_t index = 0;
+  std::shared_ptr<const Frame> rest;
 
-  void addAll(const std::vector<std::shared_ptr<Statement>> &statements);
+  // Returns null once the path has run through the whole body.
+  const Statement *next();
+  // Runs statements before resuming after the current statement.
+  void enter(const std::vector<std::shared_ptr<Statement>> &statements);
 
-  State(std::shared_ptr<Function> function);
+  State(std::shared_ptr<Function> function, ExprFactory &factory);
 };
 
+class SyntacticFeasibilityChecker : public IFeasibilityChecker {
+public:
+  bool
+  isFeasible(const std::vector<std::shared_ptr<BoolExpression>> &pc) override;
+};
+
+// Queued states of one thread, ordered by the search strategy. The owner
+// takes states with pop(); idle workers take them with steal(), which should
+// hand out work unrelated to what the owner explores next. Both return null
+// when empty. Callers serialize access.
+class Worklist {
+public:
+  virtual ~Worklist() = default;
+
+  static std::unique_ptr<Worklist> create(const ExecutionOptions &options,
+                                          uint64_t seed);
+
+  virtual void push(std::shared_ptr<State> state) = 0;
+  virtual std::shared_ptr<State> pop() = 0;
+  virtual std::shared_ptr<State> steal() = 0;
+};
+
+// Depth-first pops the newest state and lets thieves take the oldest, the
+// shallowest and usually largest subtrees; breadth-first is the reverse.
+class DequeWorklist final : public Worklist {
+public:
+  explicit DequeWorklist(bool depthFirst) : depthFirst(depthFirst) {}
+
+  void push(std::shared_ptr<State> state) override {
+    states.push_back(std::move(state));
+  }
+  std::shared_ptr<State> pop() override { return take(depthFirst); }
+  std::shared_ptr<State> steal() override { return take(!depthFirst); }
+
+private:
+  std::shared_ptr<State> take(bool newest) {
+    if (states.empty())
+      return nullptr;
+    std::shared_ptr<State> state;
+    if (newest) {
+      state = std::move(states.back());
+      states.pop_back();
+    } else {
+      state = std::move(states.front());
+      states.pop_front();
+    }
+    return state;
+  }
+
+  std::deque<std::shared_ptr<State>> states;
+  bool depthFirst;
+};
+
+// States are bucketed by depth, so a pick weighs the buckets rather than
+// every state.
+class RandomPathWorklist final : public Worklist {
+public:
+  explicit RandomPathWorklist(uint64_t seed) : random(seed) {}
+
+  void push(std::shared_ptr<State> state) override {
+    unsigned depth = state->depth;
+    buckets[depth].push_back(std::move(state));
+  }
+  std::shared_ptr<State> pop() override {
+    if (buckets.empty())
+      return nullptr;
+    // weights relative to the shallowest bucket, which keeps them in range
+    unsigned shallowest = buckets.begin()->first;
+    auto weight = [shallowest](const auto &bucket) {
+      return std::ldexp(static_cast<double>(bucket.second.size()),
+                        -static_cast<int>(bucket.first - shallowest));
+    };
+    double total = 0;
+    for (const auto &bucket : buckets)
+      total += weight(bucket);
+    double target = std::uniform_real_distribution<double>(0, total)(random);
+    auto bucket = buckets.begin();
+    for (auto it = buckets.begin(); it != buckets.end(); ++it) {
+      bucket = it;
+      target -= weight(*it);
+      if (target < 0)
+        break;
+    }
+    auto &states = bucket->second;
+    size_t index =
+        std::uniform_int_distribution<size_t>(0, states.size() - 1)(random);
+    std::shared_ptr<State> state = std::move(states[index]);
+    states[index] = std::move(states.back());
+    states.pop_back();
+    if (states.empty())
+      buckets.erase(bucket);
+    return state;
+  }
+  std::shared_ptr<State> steal() override { return pop(); }
+
+private:
+  std::map<unsigned, std::vector<std::shared_ptr<State>>> buckets;
+  std::mt19937_64 random;
+};
+
+// A heap on the hit count of the branch each state enters, newest first
+// among equals. Counts only grow, so the count seen at push may be stale:
+// a popped state whose count has grown is pushed back with the new one.
+class CoverageWorklist final : public Worklist {
+public:
+  void push(std::shared_ptr<State> state) override {
+    uint32_t hits = state->branchHits ? state->branchHits->load() : 0;
+    queue.push(Entry{hits, counter++, std::move(state)});
+  }
+  std::shared_ptr<State> pop() override {
+    while (!queue.empty()) {
+      Entry entry = queue.top();
+      queue.pop();
+      uint32_t hits = entry.state->branchHits ? entry.state->branchHits->load()
+                                              : 0;
+      if (hits == entry.hits)
+        return std::move(entry.state);
+      queue.push(Entry{hits, entry.order, std::move(entry.state)});
+    }
+    return nullptr;
+  }
+  std::shared_ptr<State> steal() override { return pop(); }
+
+private:
+  struct Entry {
+    uint32_t hits;
+    uint64_t order;
+    std::shared_ptr<State> state;
+
+    // the heap's top is the greatest entry
+    bool operator<(const Entry &other) const {
+      if (hits != other.hits)
+        return hits > other.hits;
+      return order < other.order;
+    }
+  };
+
+  std::priority_queue<Entry> queue;
+  uint64_t counter = 0;
+};
+
+std::unique_ptr<Worklist> Worklist::create(const ExecutionOptions &options,
+                                           uint64_t seed) {
+  switch (options.search) {
+  case SS_DepthFirst:
+    return std::make_unique<DequeWorklist>(/*depthFirst=*/true);
+  case SS_BreadthFirst:
+    return std::make_unique<DequeWorklist>(/*depthFirst=*/false);
+  case SS_RandomPath:
+    return std::make_unique<RandomPathWorklist>(seed);
+  case SS_CoverageGuided:
+    return std::make_unique<CoverageWorklist>();
+  }
+  throw std::runtime_error("unknown search strategy");
+}
+
+// Exploration state of one thread.
+struct Worker {
+  std::mutex mutex;
+  std::unique_ptr<Worklist> states;
+  std::vector<std::shared_ptr<Expressions>> flatValues;
+  std::vector<std::pair<std::vector<bool>, SymbolicExecutionResult>> results;
+  std::vector<AbandonedState> abandoned;
+  // statements executed, for sampling the resident set size
+  size_t steps = 0;
+};
+
+using Block = std::vector<std::shared_ptr<Statement>>;
+using States = std::vector<std::shared_ptr<State>>;
+
 class Interpreter {
 public:
-  Interpreter(std::shared_ptr<Function> function);
+  Interpreter(std::shared_ptr<Function> function, ExecutionOptions options,
+              IResultSink &sink);
 
   void execute();
 
-  std::vector<SymbolicExecutionResult> takeResults() { return std::move(results); }
+  std::vector<AbandonedState> takeAbandoned() { return std::move(abandoned); }
 
 private:
-  void step(std::shared_ptr<State> state);
+  void run(size_t self);
+  void explore(Worker &worker, std::shared_ptr<State> state);
+  // Returns null once no states are left anywhere.
+  std::shared_ptr<State> next(size_t self);
+  void push(Worker &worker, std::shared_ptr<State> state);
+
+  // Checks the global budgets before the state executes another statement;
+  // once one is exceeded, every state is abandoned at its next statement.
+  bool withinBudget(const State &state, Worker &worker);
+  void stop(AbandonReason reason);
+  void abandon(const State &state, AbandonReason reason, Worker &worker);
+  // Queues a forked state, or collects it in forks if given.
+  void schedule(Worker &worker, States *forks, std::shared_ptr<State> state);
+
+  // Executes stmt, the statement the state just took from its continuation.
+  // Returns false when the state turned out to be infeasible. Forked states
+  // go to forks when given.
+  bool step(State &state, const Statement &stmt, Worker &worker,
+            States *forks = nullptr);
+
+  struct Branch {
+    std::shared_ptr<BoolExpression> condition;
+    std::shared_ptr<const IFeasibilityChecker::Context> context;
+    const Block *block;
+    bool decision;
+  };
+
+  // Runs both branches of an if up to its join, then either merges the
+  // resulting paths into state or resumes each of them after the if.
+  bool join(State &state, const IfStmt &ifstmt, Branch (&branches)[2],
+            Worker &worker, States *forks);
+  // Runs path and everything it forks until the end of its continuation.
+  void runToJoin(std::shared_ptr<State> path, States &joined, Worker &worker);
+  // Turns state, still positioned after the if, into the union of joined.
+  // Returns false if the union is infeasible.
+  bool merge(State &state, const States &joined,
+             const std::vector<size_t> &differing);
+
+  // Returns the slots that may flow into a branch condition when block is
+  // entered, given those that may after it. Records the set at the join of
+  // every if on the way.
+  std::vector<bool> conditionSlots(const Block &block, std::vector<bool> live);
+
+  // Gives every if of block two branch counters.
+  void numberBranches(const Block &block);
+  // The hit counter of a branch; null unless search is coverage-guided.
+  std::atomic<uint32_t> *branchCounter(const IfStmt &ifstmt, bool elseBranch);
+  // Counts the branch entered by a state of its own.
+  void cover(const IfStmt &ifstmt, bool elseBranch);
+
+  bool isFeasible(const State &state,
+                  std::shared_ptr<const IFeasibilityChecker::Context> &context,
+                  std::shared_ptr<BoolExpression> condition);
+
+  std::shared_ptr<Expressions> evaluate(const Expression &expression,
+                                        FlatRange code,
+                                        const SymbolicMemory &memory,
+                                        Worker &worker);
 
 private:
   std::shared_ptr<Function> function;
-  std::vector<SymbolicExecutionResult> results;
-  std::vector<std::shared_ptr<State>> forks;
+  ExecutionOptions options;
+  IResultSink &sink;
+  // results are kept by the workers until the end to sort them
+  bool ordered;
+  std::mutex sinkMutex;
+  std::vector<AbandonedState> abandoned;
+  ExprFactory &factory;
+  std::vector<std::unique_ptr<Worker>> workers;
+  // for SM_QueryCount, the slots a branch condition may read after each if
+  std::unordered_map<const IfStmt *, std::vector<bool>> liveAfterJoin;
+  // for SS_CoverageGuided, the index of the counters of each if
+  std::unordered_map<const IfStmt *, size_t> branchIndex;
+  std::unique_ptr<std::atomic<uint32_t>[]> branchHits;
+  // states queued or being explored
+  std::atomic<size_t> pending{0};
+  std::atomic<bool> failed{false};
+  std::chrono::steady_clock::time_point deadline;
+  std::atomic<size_t> resultCount{0};
+  // the AbandonReason that stopped exploration, -1 while running
+  std::atomic<int> stopCause{-1};
+  std::exception_ptr failure;
+  std::mutex failureMutex;
 };
 
 } 
 
-State::State(std::shared_ptr<Function> function)
-    : function(function), memory(function) {
-  addAll(function->body);
+State::State(std::shared_ptr<Function> function, ExprFactory &factory)
+    : function(function), memory(function, factory), block(&function->body) {}
+
+const Statement *State::next() {
+  while (index == block->size()) {
+    if (!rest)
+      return nullptr;
+    block = rest->block;
+    index = rest->index;
+    rest = rest->parent;
+  }
+  return (*block)[index++].get();
+}
+
+void State::enter(const std::vector<std::shared_ptr<Statement>> &statements) {
+  // nothing is left to resume in a finished block, so it needs no frame
+  if (index < block->size())
+    rest = std::make_shared<const Frame>(Frame{block, index, std::move(rest)});
+  block = &statements;
+  index = 0;
+}
+
+bool SyntacticFeasibilityChecker::isFeasible(
+    const std::vector<std::shared_ptr<BoolExpression>> &pc) {
+  // conjuncts are interned, so a literal and its negation share the atom
+  std::unordered_map<const BoolExpression *, bool> literals;
+  for (const auto &conjunct : pc) {
+    if (auto *constant = dynamic_cast<const BoolConst *>(conjunct.get())) {
+      if (!constant->value)
+        return false;
+      continue;
+    }
+    const BoolExpression *atom = conjunct.get();
+    bool polarity = true;
+    if (auto *neg = dynamic_cast<const BoolNeg *>(atom)) {
+      atom = neg->subExpr.get();
+      polarity = false;
+    }
+    auto [it, New] = literals.emplace(atom, polarity);
+    if (!New && it->second != polarity)
+      return false;
+  }
+  return true;
+}
+
+bool IFeasibilityChecker::extend(std::shared_ptr<const Context> & /*context*/,
+                                 const PathCondition &pc,
+                                 std::shared_ptr<BoolExpression> condition) {
+  std::vector<std::shared_ptr<BoolExpression>> extended = pc.conjuncts();
+  extended.push_back(std::move(condition));
+  return isFeasible(extended);
+}
+
+std::shared_ptr<IFeasibilityChecker> IFeasibilityChecker::createSyntactic() {
+  return std::make_shared<SyntacticFeasibilityChecker>();
+}
+
+Interpreter::Interpreter(std::shared_ptr<Function> function,
+                         ExecutionOptions options, IResultSink &sink)
+    : function(function), options(std::move(options)), sink(sink),
+      factory(*this->options.factory) {
+  // a single depth-first thread finds results in order already
+  ordered = this->options.deterministicOrder &&
+            (this->options.jobs > 1 || this->options.search != SS_DepthFirst);
+  if (this->options.merging == SM_QueryCount)
+    conditionSlots(function->body,
+                   std::vector<bool>(function->parameters.size()));
+  if (this->options.search == SS_CoverageGuided) {
+    numberBranches(function->body);
+    branchHits =
+        std::make_unique<std::atomic<uint32_t>[]>(2 * branchIndex.size());
+  }
+}
+
+void Interpreter::numberBranches(const Block &block) {
+  for (const auto &stmt : block) {
+    if (stmt->stmtKind != SK_If)
+      continue;
+    auto &ifstmt = static_cast<const IfStmt &>(*stmt);
+    branchIndex.emplace(&ifstmt, branchIndex.size());
+    numberBranches(ifstmt.thenBlock);
+    numberBranches(ifstmt.elseBlock);
+  }
 }
 
-void State::addAll(const std::vector<std::shared_ptr<Statement>> &statements) {
-  for (int i = statements.size() - 1; i >= 0; --i)
-    statementStack.emplace_back(statements[i]);
+std::atomic<uint32_t> *Interpreter::branchCounter(const IfStmt &ifstmt,
+                                                  bool elseBranch) {
+  if (!branchHits)
+    return nullptr;
+  return &branchHits[2 * branchIndex.at(&ifstmt) + elseBranch];
 }
 
-Interpreter::Interpreter(std::shared_ptr<Function> function)
-    : function(function) {}
+void Interpreter::cover(const IfStmt &ifstmt, bool elseBranch) {
+  if (auto *counter = branchCounter(ifstmt, elseBranch))
+    ++*counter;
+}
+
+std::vector<bool> Interpreter::conditionSlots(const Block &block,
+                                              std::vector<bool> live) {
+  for (auto it = block.rbegin(); it != block.rend(); ++it) {
+    const Statement &stmt = **it;
+    switch (stmt.stmtKind) {
+    case SK_Assignment: {
+      auto &assignment = static_cast<const Assignment &>(stmt);
+      if (live[assignment.slot]) {
+        live[assignment.slot] = false;
+        markReads(*assignment.value, live);
+      }
+      break;
+    }
+    case SK_If: {
+      auto &ifstmt = static_cast<const IfStmt &>(stmt);
+      liveAfterJoin[&ifstmt] = live;
+      std::vector<bool> thenLive = conditionSlots(ifstmt.thenBlock, live);
+      live = conditionSlots(ifstmt.elseBlock, std::move(live));
+      for (size_t slot = 0; slot < live.size(); ++slot)
+        live[slot] = live[slot] || thenLive[slot];
+      markReads(*ifstmt.condition, live);
+      break;
+    }
+    case SK_Error:
+      break;
+    }
+  }
+  return live;
+}
 
 void Interpreter::execute() {
-  forks.emplace_back(std::make_shared<State>(function));
-  while (!forks.empty()) {
-    std::shared_ptr<State> fork = std::move(forks.back());
-    forks.pop_back();
-    while (!fork->statementStack.empty()) {
-      step(fork);
-    }
-    auto result = ::processExpr(function->returnValue, fork->memory);
-    results.emplace_back(SymbolicExecutionResult{
-        .memory = fork->memory,
-        .pc = conjunction(fork->pc),
-        .result = std::move(result),
-    });
-  }
-}
-
-void Interpreter::step(std::shared_ptr<State> state) {
-  auto stmt = std::move(state->statementStack.back());
-  state->statementStack.pop_back();
-  if (auto *assignment = dynamic_cast<const Assignment *>(stmt.get())) {
-    auto value = processExpr(assignment->value, state->memory);
-    state->memory.set(assignment->var, std::move(value));
-    return;
-  }
-  if (auto *ifstmt = dynamic_cast<const IfStmt *>(stmt.get())) {
-    auto condition = std::dynamic_pointer_cast<BoolExpression>(
-        processExpr(ifstmt->condition, state->memory));
-    assert(condition);
-    auto fork = std::make_shared<State>(*state);
-    state->pc.push_back(condition);
-    state->addAll(ifstmt->thenBlock);
-    fork->pc.push_back(std::make_shared<BoolNeg>(condition));
-    fork->addAll(ifstmt->elseBlock);
-    forks.emplace_back(std::move(fork));
-    return;
+  size_t jobs = std::max(1u, options.jobs);
+  for (size_t i = 0; i < jobs; ++i) {
+    workers.push_back(std::make_unique<Worker>());
+    workers.back()->states = Worklist::create(options, options.seed + i);
+  }
+  deadline = std::chrono::steady_clock::now() + options.timeout;
+  push(*workers.front(), std::make_shared<State>(function, factory));
+  if (jobs == 1) {
+    run(0);
+  } else {
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < jobs; ++i)
+      threads.emplace_back([this, i] { run(i); });
+    for (std::thread &thread : threads)
+      thread.join();
+  }
+  if (failure)
+    std::rethrow_exception(failure);
+
+  std::vector<std::pair<std::vector<bool>, SymbolicExecutionResult>> found;
+  for (auto &worker : workers) {
+    std::move(worker->results.begin(), worker->results.end(),
+              std::back_inserter(found));
+    // states still queued when a budget stopped exploration
+    while (auto state = worker->states->pop())
+      abandon(*state, static_cast<AbandonReason>(stopCause.load()), *worker);
+    std::move(worker->abandoned.begin(), worker->abandoned.end(),
+              std::back_inserter(abandoned));
+  }
+  // depth-first order takes then before else, so sorting by the decisions
+  // reproduces the order of a single thread
+  if (options.deterministicOrder)
+    std::stable_sort(found.begin(), found.end(),
+                     [](const auto &lhs, const auto &rhs) {
+                       return lhs.first < rhs.first;
+                     });
+  for (auto &[decisions, result] : found)
+    sink.accept(std::move(result));
+}
+
+// Current resident set size, or 0 where it cannot be read.
+static size_t residentBytes() {
+#ifdef __linux__
+  std::ifstream statm("/proc/self/statm");
+  size_t total = 0;
+  size_t resident = 0;
+  if (statm >> total >> resident)
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+  return 0;
+}
+
+bool Interpreter::withinBudget(const State &state, Worker &worker) {
+  // reading the resident set size costs a system call
+  constexpr size_t MemorySampleInterval = 256;
+  if (stopCause < 0) {
+    if (options.timeout.count() > 0 &&
+        std::chrono::steady_clock::now() >= deadline)
+      stop(AR_Timeout);
+    else if (options.maxResidentBytes &&
+             worker.steps++ % MemorySampleInterval == 0 &&
+             residentBytes() > options.maxResidentBytes)
+      stop(AR_MemoryLimit);
+  }
+  int cause = stopCause;
+  if (cause < 0)
+    return true;
+  abandon(state, static_cast<AbandonReason>(cause), worker);
+  return false;
+}
+
+void Interpreter::stop(AbandonReason reason) {
+  int running = -1;
+  stopCause.compare_exchange_strong(running, reason);
+}
+
+void Interpreter::abandon(const State &state, AbandonReason reason,
+                          Worker &worker) {
+  worker.abandoned.push_back(
+      AbandonedState{reason, state.pc.conjunction(factory), state.depth});
+}
+
+void Interpreter::run(size_t self) {
+  try {
+    while (auto state = next(self))
+      explore(*workers[self], std::move(state));
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(failureMutex);
+    if (!failure)
+      failure = std::current_exception();
+    failed = true;
+  }
+}
+
+void Interpreter::explore(Worker &worker, std::shared_ptr<State> state) {
+  state->countBranch();
+  bool feasible = true;
+  while (feasible) {
+    const Statement *stmt = state->next();
+    if (!stmt)
+      break;
+    feasible = withinBudget(*state, worker) && step(*state, *stmt, worker);
+  }
+  if (feasible && options.maxResults) {
+    size_t index = resultCount++;
+    if (index + 1 >= options.maxResults)
+      stop(AR_MaxResults);
+    if (index >= options.maxResults) {
+      abandon(*state, AR_MaxResults, worker);
+      feasible = false;
+    }
+  }
+  if (feasible) {
+    SymbolicExecutionResult result{
+        .memory = state->memory,
+        .pc = state->pc.conjunction(factory),
+        .result = evaluate(*function->returnValue, function->returnCode,
+                           state->memory, worker),
+    };
+    if (ordered) {
+      worker.results.emplace_back(std::move(state->decisions),
+                                  std::move(result));
+    } else {
+      std::lock_guard<std::mutex> lock(sinkMutex);
+      sink.accept(std::move(result));
+    }
+  }
+  --pending;
+}
+
+std::shared_ptr<State> Interpreter::next(size_t self) {
+  while (!failed && stopCause < 0) {
+    {
+      Worker &own = *workers[self];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if (auto state = own.states->pop())
+        return state;
+    }
+    for (size_t offset = 1; offset < workers.size(); ++offset) {
+      Worker &victim = *workers[(self + offset) % workers.size()];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (auto state = victim.states->steal())
+        return state;
+    }
+    if (pending == 0)
+      return nullptr;
+    std::this_thread::yield();
+  }
+  return nullptr;
+}
+
+void Interpreter::push(Worker &worker, std::shared_ptr<State> state) {
+  ++pending;
+  std::lock_guard<std::mutex> lock(worker.mutex);
+  worker.states->push(std::move(state));
+}
+
+void Interpreter::schedule(Worker &worker, States *forks,
+                           std::shared_ptr<State> state) {
+  if (forks)
+    forks->push_back(std::move(state));
+  else
+    push(worker, std::move(state));
+}
+
+bool Interpreter::step(State &state, const Statement &stmt, Worker &worker,
+                       States *forks) {
+  switch (stmt.stmtKind) {
+  case SK_Assignment: {
+    auto &assignment = static_cast<const Assignment &>(stmt);
+    auto value = evaluate(*assignment.value, assignment.valueCode,
+                          state.memory, worker);
+    state.memory.set(assignment.slot, std::move(value));
+    return true;
+  }
+  case SK_If: {
+    auto &ifstmt = static_cast<const IfStmt &>(stmt);
+    auto condition = asBool(evaluate(*ifstmt.condition, ifstmt.conditionCode,
+                                     state.memory, worker));
+    auto negation = factory.boolNeg(condition);
+    auto thenContext = state.feasibility;
+    auto elseContext = state.feasibility;
+    bool thenFeasible = isFeasible(state, thenContext, condition);
+    bool elseFeasible = isFeasible(state, elseContext, negation);
+    if (thenFeasible && elseFeasible && options.maxDepth &&
+        state.depth >= options.maxDepth) {
+      abandon(state, AR_MaxDepth, worker);
+      return false;
+    }
+    if (thenFeasible && elseFeasible && options.merging != SM_Never) {
+      Branch branches[2] = {
+          {std::move(condition), std::move(thenContext), &ifstmt.thenBlock,
+           false},
+          {std::move(negation), std::move(elseContext), &ifstmt.elseBlock,
+           true},
+      };
+      return join(state, ifstmt, branches, worker, forks);
+    }
+    if (thenFeasible && elseFeasible) {
+      ++state.depth;
+      auto fork = std::make_shared<State>(state);
+      fork->branchHits = branchCounter(ifstmt, /*elseBranch=*/true);
+      fork->pc = fork->pc.extend(factory, std::move(negation));
+      fork->feasibility = std::move(elseContext);
+      if (options.deterministicOrder)
+        fork->decisions.push_back(true);
+      fork->enter(ifstmt.elseBlock);
+      schedule(worker, forks, std::move(fork));
+    }
+    if (thenFeasible) {
+      cover(ifstmt, /*elseBranch=*/false);
+      state.pc = state.pc.extend(factory, std::move(condition));
+      state.feasibility = std::move(thenContext);
+      if (options.deterministicOrder)
+        state.decisions.push_back(false);
+      state.enter(ifstmt.thenBlock);
+      return true;
+    }
+    if (elseFeasible) {
+      cover(ifstmt, /*elseBranch=*/true);
+      state.pc = state.pc.extend(factory, std::move(negation));
+      state.feasibility = std::move(elseContext);
+      if (options.deterministicOrder)
+        state.decisions.push_back(true);
+      state.enter(ifstmt.elseBlock);
+      return true;
+    }
+    return false;
+  }
+  case SK_Error:
+    break;
   }
   throw std::runtime_error("failed to interpret invalid statement");
 }
 
+bool Interpreter::join(State &state, const IfStmt &ifstmt,
+                       Branch (&branches)[2], Worker &worker, States *forks) {
+  States joined;
+  for (Branch &branch : branches) {
+    auto path = std::make_shared<State>(state);
+    path->pc = state.pc.extend(factory, std::move(branch.condition));
+    path->feasibility = std::move(branch.context);
+    if (options.deterministicOrder)
+      path->decisions.push_back(branch.decision);
+    ++path->depth;
+    cover(ifstmt, branch.decision);
+    // the branch alone, so the path stops at the join
+    path->block = branch.block;
+    path->index = 0;
+    path->rest = nullptr;
+    runToJoin(std::move(path), joined, worker);
+  }
+  if (joined.empty())
+    return false;
+
+  std::vector<size_t> differing;
+  for (size_t slot = 0; slot < function->parameters.size(); ++slot) {
+    auto value = joined.front()->memory.get(slot);
+    for (const auto &path : joined) {
+      if (path->memory.get(slot) != value) {
+        differing.push_back(slot);
+        break;
+      }
+    }
+  }
+  bool profitable = true;
+  if (options.merging == SM_QueryCount) {
+    const std::vector<bool> &live = liveAfterJoin.at(&ifstmt);
+    profitable = std::none_of(differing.begin(), differing.end(),
+                              [&](size_t slot) { return live[slot]; });
+  }
+  if (joined.size() > 1 && profitable)
+    return merge(state, joined, differing);
+
+  // keep the paths apart, each resuming after the if
+  for (auto &path : joined) {
+    path->block = state.block;
+    path->index = state.index;
+    path->rest = state.rest;
+  }
+  for (size_t i = 1; i < joined.size(); ++i)
+    schedule(worker, forks, std::move(joined[i]));
+  state = std::move(*joined.front());
+  return true;
+}
+
+void Interpreter::runToJoin(std::shared_ptr<State> path, States &joined,
+                            Worker &worker) {
+  States paths{std::move(path)};
+  while (!paths.empty()) {
+    std::shared_ptr<State> current = std::move(paths.back());
+    paths.pop_back();
+    current->countBranch();
+    bool feasible = true;
+    while (feasible) {
+      const Statement *stmt = current->next();
+      if (!stmt)
+        break;
+      feasible = withinBudget(*current, worker) &&
+                 step(*current, *stmt, worker, &paths);
+    }
+    if (feasible)
+      joined.push_back(std::move(current));
+  }
+}
+
+bool Interpreter::merge(State &state, const States &joined,
+                        const std::vector<size_t> &differing) {
+  // what each path assumed since the if
+  std::vector<std::shared_ptr<BoolExpression>> guards;
+  for (const auto &path : joined)
+    guards.push_back(conjunction(factory, path->pc.conjunctsSince(state.pc)));
+
+  SymbolicMemory memory = joined.front()->memory;
+  for (size_t slot : differing) {
+    // the last path needs no guard: some path was taken
+    std::shared_ptr<Expressions> value = joined.back()->memory.get(slot);
+    for (size_t i = joined.size() - 1; i-- > 0;) {
+      auto taken = joined[i]->memory.get(slot);
+      if (function->parameters[slot].type == T_INT)
+        value = factory.intIte(guards[i], asInt(std::move(taken)),
+                               asInt(std::move(value)));
+      else
+        value = factory.boolIte(guards[i], asBool(std::move(taken)),
+                                asBool(std::move(value)));
+    }
+    memory.set(slot, std::move(value));
+  }
+  state.memory = std::move(memory);
+
+  auto disjunction = guards.front();
+  for (size_t i = 1; i < guards.size(); ++i)
+    disjunction = factory.boolOr(std::move(disjunction), guards[i]);
+  // then and else without further branches cover every input
+  if (auto *constant = dynamic_cast<const BoolConst *>(disjunction.get()))
+    if (constant->value)
+      return true;
+  if (!isFeasible(state, state.feasibility, disjunction))
+    return false;
+  state.pc = state.pc.extend(factory, std::move(disjunction));
+  return true;
+}
+
+bool Interpreter::isFeasible(
+    const State &state,
+    std::shared_ptr<const IFeasibilityChecker::Context> &context,
+    std::shared_ptr<BoolExpression> condition) {
+  if (!options.feasibility)
+    return true;
+  return options.feasibility->extend(context, state.pc, std::move(condition));
+}
+
+std::shared_ptr<Expressions>
+Interpreter::evaluate(const Expression &expression, FlatRange code,
+                      const SymbolicMemory &memory, Worker &worker) {
+  if (function->code)
+    return processFlatExpr(*function->code, code, memory, factory,
+                           worker.flatValues);
+  return processExpr(expression, memory, factory);
+}
+
 std::vector<SymbolicExecutionResult>
-mysym::execute(std::shared_ptr<Function> function) {
-  Interpreter interpreter(std::move(function));
+mysym::execute(std::shared_ptr<Function> function,
+               const ExecutionOptions &options) {
+  ExecutionReport report = executeWithReport(std::move(function), options);
+  if (!report.abandoned.empty())
+    throw std::runtime_error("symbolic execution stopped early: " +
+                             toString(report.abandoned.front().reason));
+  return std::move(report.results);
+}
+
+namespace {
+
+class CollectingSink : public IResultSink {
+public:
+  explicit CollectingSink(std::vector<SymbolicExecutionResult> &results)
+      : results(results) {}
+
+  void accept(SymbolicExecutionResult result) override {
+    results.push_back(std::move(result));
+  }
+
+private:
+  std::vector<SymbolicExecutionResult> &results;
+};
+
+} 
+
+ExecutionReport mysym::executeWithReport(std::shared_ptr<Function> function,
+                                         const ExecutionOptions &options) {
+  ExecutionReport report;
+  CollectingSink sink(report.results);
+  report.abandoned = execute(std::move(function), sink, options);
+  return report;
+}
+
+std::vector<AbandonedState>
+mysym::execute(std::shared_ptr<Function> function, IResultSink &sink,
+               const ExecutionOptions &options) {
+  Interpreter interpreter(std::move(function), options, sink);
   interpreter.execute();
-  return interpreter.takeResults();
+  return interpreter.takeAbandoned();
+}
+
+std::string mysym::toString(AbandonReason reason) {
+  switch (reason) {
+  case AR_MaxResults:
+    return "max results";
+  case AR_MaxDepth:
+    return "max depth";
+  case AR_Timeout:
+    return "timeout";
+  case AR_MemoryLimit:
+    return "memory limit";
+  }
+  return "unknown";
 }
\ No newline at end of file
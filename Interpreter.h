@@ -1,7 +1,10 @@
 #pragma once
 
+#include "ExprFactory.h"
 #include "Expressions.h"
 #include "SymbolicMemory.h"
+#include <chrono>
+#include <string>
 #include <vector>
 
 namespace cereal {
@@ -10,14 +13,231 @@ class JSONOutputArchive;
 
 namespace mysym {
 
+class QueryCache;
+
 struct SymbolicExecutionResult {
   SymbolicMemory memory;
   std::shared_ptr<BoolExpression> pc;
   std::shared_ptr<Expressions> result;
 
+  // The JSON layout of a result, which save() and the JSON formats of
+  // ResultFormat.h all go through. Writes the fields into an object the
+  // caller has opened on json, a handler with the SAX interface of
+  // rapidjson's writers, rendering expressions in style.
+  template <typename Json>
+  void writeFields(Json &json, ExpressionStyle style) const;
+
   void save(cereal::JSONOutputArchive &out) const;
 };
 
-std::vector<SymbolicExecutionResult> execute(std::shared_ptr<Function> function);
+template <typename Json>
+void SymbolicExecutionResult::writeFields(Json &json,
+                                          ExpressionStyle style) const {
+  auto string = [&json](const std::string &text) {
+    json.String(text.data(), static_cast<unsigned>(text.size()), true);
+  };
+  auto key = [&json](const char *name) {
+    json.Key(name,
+             static_cast<unsigned>(std::char_traits<char>::length(name)));
+  };
+  key("values");
+  json.StartArray();
+  for (size_t slot = 0; slot < memory.size(); ++slot) {
+    json.StartObject();
+    key("name");
+    string(memory.name(slot));
+    key("value");
+    string(render(*memory.get(slot), style));
+    json.EndObject();
+  }
+  json.EndArray();
+  key("pc");
+  string(render(*pc, style));
+  key("result");
+  string(render(*result, style));
+}
+
+// Path condition as an immutable list linked towards its first conjunct, so
+// forked paths share their common prefix and extending one is O(1). Every
+// node also keeps the conjunction of its whole prefix, built on top of its
+// parent's, so the final path conditions of all paths share one DAG.
+class PathCondition {
+public:
+  // the empty path condition
+  PathCondition() = default;
+
+  PathCondition extend(ExprFactory &factory,
+                       std::shared_ptr<BoolExpression> condition) const;
+
+  bool empty() const { return !head; }
+  size_t size() const { return head ? head->size : 0; }
+  // true for the empty path condition
+  std::shared_ptr<BoolExpression> conjunction(ExprFactory &factory) const;
+  // the conditions in the order they were added
+  std::vector<std::shared_ptr<BoolExpression>> conjuncts() const;
+  // the conditions added after prefix, which this path condition extends
+  std::vector<std::shared_ptr<BoolExpression>>
+  conjunctsSince(const PathCondition &prefix) const;
+
+private:
+  struct Node {
+    std::shared_ptr<const Node> parent;
+    std::shared_ptr<BoolExpression> condition;
+    std::shared_ptr<BoolExpression> conjunction;
+    size_t size;
+  };
+
+  std::shared_ptr<const Node> head;
+};
+
+// Decides whether a path condition, given as a list of conjuncts, may be
+// satisfiable. Answering true for an unsatisfiable path condition is always
+// safe; answering false prunes the path.
+class IFeasibilityChecker {
+public:
+  virtual ~IFeasibilityChecker() = default;
+
+  // Rejects constant false conjuncts and pairs of complementary conjuncts.
+  static std::shared_ptr<IFeasibilityChecker> createSyntactic();
+  // Decides the path condition with the embedded solver (see Solver.h);
+  // only queries proven unsatisfiable are rejected. Queries go through
+  // cache first; the first overload uses a fresh cache of its own.
+  static std::shared_ptr<IFeasibilityChecker> createSolver();
+  static std::shared_ptr<IFeasibilityChecker>
+  createSolver(std::shared_ptr<QueryCache> cache);
+
+  virtual bool
+  isFeasible(const std::vector<std::shared_ptr<BoolExpression>> &pc) = 0;
+
+  // State an incremental checker keeps for one path. Forked paths share
+  // their parent's context, so it must not change once created.
+  class Context {
+  public:
+    virtual ~Context() = default;
+  };
+
+  // Decides pc extended by condition. context is what the previous call on
+  // this path left behind (null at the start of the path) and is replaced by
+  // the context of the extended path when the result is true. The default
+  // checks the whole conjunction with isFeasible().
+  virtual bool extend(std::shared_ptr<const Context> &context,
+                      const PathCondition &pc,
+                      std::shared_ptr<BoolExpression> condition);
+};
+
+enum StateMerging {
+  // every feasible branch continues as a path of its own
+  SM_Never,
+  // Merges the paths through an if/else at its join unless they disagree on
+  // a variable a later branch condition may read. Merged values become ite
+  // expressions, and every query on such a variable would have to case split
+  // on them, so this is a static estimate of the queries merging makes
+  // harder, in the spirit of query count estimation.
+  SM_QueryCount,
+  // merges at every join
+  SM_Always,
+};
+
+enum SearchStrategy {
+  SS_DepthFirst,
+  SS_BreadthFirst,
+  // Picks a state with probability proportional to 2^-depth, depth being
+  // the number of forks on its path, as a random walk down the tree of forks
+  // would. Favors shallow states without starving deep ones.
+  SS_RandomPath,
+  // prefers states about to enter the branch explored least so far
+  SS_CoverageGuided,
+};
+
+struct ExecutionOptions {
+  // Builds every expression. Declared before feasibility, which keeps
+  // expressions of its own, so that it is destroyed after it; executions
+  // sharing the options share the factory.
+  std::shared_ptr<ExprFactory> factory = std::make_shared<ExprFactory>();
+  // consulted before a branch is explored; null disables pruning
+  std::shared_ptr<IFeasibilityChecker> feasibility =
+      IFeasibilityChecker::createSolver();
+  // Threads exploring paths. With more than one, feasibility is called
+  // concurrently; the built-in checkers allow that.
+  unsigned jobs = 1;
+  // Orders results by the branches taken, which reproduces the order of a
+  // single thread whatever the number of jobs.
+  bool deterministicOrder = false;
+  // Merged paths report one result whose values and path condition cover
+  // all of them: values differing between paths become ite expressions and
+  // the path condition gains the disjunction of the branch conditions.
+  StateMerging merging = SM_Never;
+  // Order in which each thread explores its queued states. Only the order
+  // of results differs unless exploration is cut short.
+  SearchStrategy search = SS_DepthFirst;
+  // seeds SS_RandomPath
+  uint64_t seed = 0;
+
+  // Budgets, zero meaning unlimited. Once one is hit, execute() throws and
+  // executeWithReport() returns what was found so far.
+  size_t maxResults = 0;
+  // paths needing more forks are abandoned; the others go on
+  unsigned maxDepth = 0;
+  std::chrono::milliseconds timeout{0};
+  // resident set size of the process, sampled while exploring; only
+  // enforced where it can be read (Linux)
+  size_t maxResidentBytes = 0;
+};
+
+enum AbandonReason {
+  AR_MaxResults,
+  AR_MaxDepth,
+  AR_Timeout,
+  AR_MemoryLimit,
+};
+
+std::string toString(AbandonReason reason);
+
+// A state left unexplored when a budget ran out.
+struct AbandonedState {
+  AbandonReason reason;
+  // the path condition it had reached
+  std::shared_ptr<BoolExpression> pc;
+  // forks on its path
+  unsigned depth;
+};
+
+struct ExecutionReport {
+  std::vector<SymbolicExecutionResult> results;
+  // empty if every path was explored
+  std::vector<AbandonedState> abandoned;
+};
+
+// Receives results as their paths finish, so that they need not all be held
+// until exploration ends: once the sink lets go of a result, the ExprFactory
+// of the options drops the nodes nothing else holds, and memory follows the
+// states still queued. The solver of the default feasibility checker keeps
+// the translations of the branch conditions it has decided.
+class IResultSink {
+public:
+  virtual ~IResultSink() = default;
+
+  // Called for one result at a time, possibly from different threads. With
+  // deterministicOrder and several jobs, results are only known to be in
+  // order at the end, so they are all passed on once exploration is over.
+  virtual void accept(SymbolicExecutionResult result) = 0;
+};
+
+// Throws std::runtime_error if a budget of options is exceeded.
+std::vector<SymbolicExecutionResult>
+execute(std::shared_ptr<Function> function,
+        const ExecutionOptions &options = ExecutionOptions());
+
+// Passes every result to sink as soon as its path finishes. Returns the
+// states abandoned when a budget ran out, empty if every path was explored.
+std::vector<AbandonedState>
+execute(std::shared_ptr<Function> function, IResultSink &sink,
+        const ExecutionOptions &options = ExecutionOptions());
+
+// Explores within the budgets of options, reporting the results found and
+// the states abandoned when a budget ran out.
+ExecutionReport
+executeWithReport(std::shared_ptr<Function> function,
+                  const ExecutionOptions &options = ExecutionOptions());
 
 }
@@ -2,20 +2,129 @@
 #include "LangLexer.h"
 #include "LangParser.h"
 #include "Interpreter.h"
-#include "cereal/archives/json.hpp"
-#include "cereal/types/vector.hpp"
+#include "QueryCache.h"
+#include "ResultFormat.h"
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
 #include <filesystem>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <string_view>
 
 using namespace antlr4;
 using namespace mysym;
 
+static uint64_t numberArgument(std::string_view flag, const char *value,
+                               uint64_t min, uint64_t max) {
+  char *end = nullptr;
+  errno = 0;
+  unsigned long long number = std::strtoull(value, &end, 10);
+  if (!std::isdigit(static_cast<unsigned char>(*value)) || *end != '\0' ||
+      errno == ERANGE || number < min || number > max) {
+    std::cerr << flag << " expects a number from " << min << " to " << max
+              << '\n';
+    std::exit(1);
+  }
+  return number;
+}
+
+template <typename T>
+static T positiveArgument(std::string_view flag, const char *value,
+                          T max = std::numeric_limits<T>::max()) {
+  return numberArgument(flag, value, 1, max);
+}
+
 int main(int argc, const char **argv) {
-  if (argc <= 1) {
+  const char *source = nullptr;
+  bool printStats = false;
+  bool partial = false;
+  bool flatCode = true;
+  ResultFormat format = RF_Json;
+  ExpressionStyle style = ES_Tree;
+  ExecutionOptions options;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg(argv[i]);
+    auto value = [&] {
+      if (i + 1 == argc) {
+        std::cerr << arg << " expects a value\n";
+        std::exit(1);
+      }
+      return argv[++i];
+    };
+    if (arg == "--stats") {
+      printStats = true;
+    } else if (arg == "--tree") {
+      flatCode = false;
+    } else if (arg == "--deterministic") {
+      options.deterministicOrder = true;
+    } else if (arg == "--merge") {
+      options.merging = SM_QueryCount;
+    } else if (arg == "--merge=always") {
+      options.merging = SM_Always;
+    } else if (arg == "--search") {
+      std::string_view name(value());
+      if (name == "dfs") {
+        options.search = SS_DepthFirst;
+      } else if (name == "bfs") {
+        options.search = SS_BreadthFirst;
+      } else if (name == "random") {
+        options.search = SS_RandomPath;
+      } else if (name == "coverage") {
+        options.search = SS_CoverageGuided;
+      } else {
+        std::cerr << "--search expects dfs, bfs, random or coverage\n";
+        std::exit(1);
+      }
+    } else if (arg == "--seed") {
+      options.seed = numberArgument(arg, value(), 0, UINT64_MAX);
+    } else if (arg == "--jobs") {
+      options.jobs = positiveArgument<unsigned>(arg, value());
+    } else if (arg == "--max-results") {
+      options.maxResults = positiveArgument<size_t>(arg, value());
+    } else if (arg == "--max-depth") {
+      options.maxDepth = positiveArgument<unsigned>(arg, value());
+    } else if (arg == "--timeout-ms") {
+      // the deadline is the current time plus the timeout, in clock ticks
+      auto longest = std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::duration::max() / 2);
+      options.timeout = std::chrono::milliseconds(
+          positiveArgument(arg, value(), longest.count()));
+    } else if (arg == "--max-memory-mb") {
+      options.maxResidentBytes =
+          positiveArgument<size_t>(arg, value(), SIZE_MAX >> 20) << 20;
+    } else if (arg == "--partial") {
+      partial = true;
+    } else if (arg == "--format=json") {
+      format = RF_Json;
+    } else if (arg == "--format=ndjson") {
+      format = RF_NdJson;
+    } else if (arg == "--format=bin") {
+      format = RF_Binary;
+    } else if (arg == "--format=indexed") {
+      format = RF_Indexed;
+    } else if (arg == "--shared") {
+      style = ES_Shared;
+    } else if (arg.substr(0, 8) == "--format") {
+      std::cerr << "--format expects =json, =ndjson, =bin or =indexed\n";
+      std::exit(1);
+    } else if (arg.substr(0, 2) == "--") {
+      std::cerr << "unknown option " << arg << '\n';
+      std::exit(1);
+    } else if (source) {
+      std::cerr << "expected a single source file\n";
+      std::exit(1);
+    } else {
+      source = argv[i];
+    }
+  }
+  if (!source) {
     std::cerr << "print path to .txt\n";
     std::exit(1);
   }
-  std::filesystem::path path(argv[1]);
+  std::filesystem::path path(source);
   std::ifstream istream(path);
   ANTLRInputStream input(istream);
   LangLexer lexer(&input);
@@ -29,7 +138,7 @@ int main(int argc, const char **argv) {
     std::exit(1);
   }
 
-  auto builder = IASTBuilder::create();
+  auto builder = IASTBuilder::create(flatCode);
   tree::ParseTreeWalker::DEFAULT.walk(builder.get(), tree);
   if (builder->hasErrors()) {
     std::cerr << "semantic errors\n";
@@ -37,10 +146,39 @@ int main(int argc, const char **argv) {
   }
 
   auto function = builder->getFunction();
-  auto executionResults = execute(function);
+  auto cache = std::make_shared<QueryCache>();
+  options.feasibility = IFeasibilityChecker::createSolver(cache);
+  std::vector<AbandonedState> abandoned;
   {
-    cereal::JSONOutputArchive archive(std::cout);
-    cereal::save(archive, executionResults);
+    auto writer = ResultWriter::create(format, std::cout, style);
+    abandoned = execute(function, *writer, options);
+    writer->finish();
+  }
+  if (format == RF_Json)
+    std::cout << std::endl;
+
+  if (!abandoned.empty()) {
+    std::map<AbandonReason, size_t> reasons;
+    for (const AbandonedState &state : abandoned)
+      ++reasons[state.reason];
+    std::cerr << abandoned.size() << " states abandoned:";
+    for (const auto &[reason, count] : reasons)
+      std::cerr << ' ' << toString(reason) << ' ' << count;
+    std::cerr << '\n';
+  }
+
+  if (printStats) {
+    QueryCacheStats stats = cache->stats();
+    std::cerr << "solver cache: " << stats.hits() << " hits (exact "
+              << stats.exactHits << ", unsat subset " << stats.unsatSubsetHits
+              << ", sat superset " << stats.satSupersetHits << ", model "
+              << stats.modelHits << "), " << stats.misses << " misses, "
+              << stats.evictions << " evictions\n";
+  }
+
+  if (!abandoned.empty() && !partial) {
+    std::cerr << "stopped early: " << toString(abandoned.front().reason)
+              << " (use --partial to accept the paths found)\n";
+    std::exit(1);
   }
-  std::cout << std::endl;
 }
\ No newline at end of file
@@ -0,0 +1,193 @@
+#include "QueryCache.h"
+#include <algorithm>
+#include <functional>
+
+using namespace mysym;
+
+static bool byAddress(const std::shared_ptr<BoolExpression> &lhs,
+                      const std::shared_ptr<BoolExpression> &rhs) {
+  return std::less<const BoolExpression *>()(lhs.get(), rhs.get());
+}
+
+static bool contains(const QueryCache::Key &set,
+                     const QueryCache::Key &subset) {
+  return subset.size() <= set.size() &&
+         std::includes(set.begin(), set.end(), subset.begin(), subset.end(),
+                       byAddress);
+}
+
+static size_t combineHash(size_t seed, size_t value) {
+  return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+size_t QueryCache::KeyHash::operator()(const Key &key) const {
+  size_t hash = key.size();
+  for (const auto &conjunct : key)
+    hash = combineHash(hash, std::hash<const void *>()(conjunct.get()));
+  return hash;
+}
+
+QueryCache::Key
+QueryCache::makeKey(std::vector<std::shared_ptr<BoolExpression>> conjuncts) {
+  std::sort(conjuncts.begin(), conjuncts.end(), byAddress);
+  conjuncts.erase(std::unique(conjuncts.begin(), conjuncts.end()),
+                  conjuncts.end());
+  return conjuncts;
+}
+
+std::optional<SatResult>
+QueryCache::lookup(const Key &key, std::shared_ptr<const Model> *model) {
+  std::unique_lock<std::mutex> lock(mutex);
+  auto it = entries.find(key);
+  if (it != entries.end()) {
+    ++counters.exactHits;
+    touch(it->second);
+    if (model)
+      *model = it->second.model;
+    return it->second.result;
+  }
+
+  // A cached unsatisfiable subset is anchored at one of the query's
+  // conjuncts. Paths that share most of their conjuncts fill every list,
+  // so the scan stops after scanLimit candidates.
+  size_t scanned = 0;
+  for (const auto &conjunct : key) {
+    auto candidates = unsatByAnchor.find(conjunct.get());
+    if (candidates == unsatByAnchor.end())
+      continue;
+    for (auto unsat = candidates->second.rbegin();
+         unsat != candidates->second.rend() && scanned < scanLimit;
+         ++unsat, ++scanned) {
+      if (contains(key, (*unsat)->first)) {
+        ++counters.unsatSubsetHits;
+        touch((*unsat)->second);
+        return SatResult::Unsat;
+      }
+    }
+  }
+
+  // A cached satisfiable superset contains every conjunct of the query, so
+  // the shortest list of entries containing one of them is enough to scan.
+  const std::vector<Node *> *candidates = nullptr;
+  for (const auto &conjunct : key) {
+    auto found = satByConjunct.find(conjunct.get());
+    if (found == satByConjunct.end()) {
+      candidates = nullptr;
+      break;
+    }
+    if (!candidates || found->second.size() < candidates->size())
+      candidates = &found->second;
+  }
+  if (candidates) {
+    scanned = 0;
+    for (auto sat = candidates->rbegin();
+         sat != candidates->rend() && scanned < scanLimit;
+         ++sat, ++scanned) {
+      if (contains((*sat)->first, key)) {
+        ++counters.satSupersetHits;
+        Entry &entry = (*sat)->second;
+        touch(entry);
+        if (model)
+          *model = entry.model;
+        return SatResult::Sat;
+      }
+    }
+  }
+
+  // Models are evaluated without holding the lock.
+  std::vector<std::shared_ptr<const Model>> recent;
+  for (auto use = recency.begin();
+       use != recency.end() && recent.size() < scanLimit; ++use) {
+    if ((*use)->second.result == SatResult::Sat)
+      recent.push_back((*use)->second.model);
+  }
+  lock.unlock();
+  for (auto &candidate : recent) {
+    bool satisfies =
+        std::all_of(key.begin(), key.end(), [&](const auto &conjunct) {
+          return candidate->satisfies(*conjunct);
+        });
+    if (satisfies) {
+      lock.lock();
+      ++counters.modelHits;
+      if (model)
+        *model = std::move(candidate);
+      return SatResult::Sat;
+    }
+  }
+
+  lock.lock();
+  ++counters.misses;
+  return std::nullopt;
+}
+
+void QueryCache::insert(Key key, SatResult result,
+                        std::shared_ptr<const Model> model) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto [it, New] =
+      entries.emplace(std::move(key), Entry{result, std::move(model), {}});
+  if (!New) {
+    touch(it->second);
+    return;
+  }
+  Node *node = &*it;
+  recency.push_front(node);
+  node->second.use = recency.begin();
+  if (result == SatResult::Unsat && !node->first.empty()) {
+    const BoolExpression *anchor = nullptr;
+    size_t fewest = 0;
+    for (const auto &conjunct : node->first) {
+      auto listed = unsatByAnchor.find(conjunct.get());
+      size_t count =
+          listed == unsatByAnchor.end() ? 0 : listed->second.size();
+      if (!anchor || count < fewest) {
+        anchor = conjunct.get();
+        fewest = count;
+      }
+      if (count == 0)
+        break;
+    }
+    node->second.anchor = anchor;
+    unsatByAnchor[anchor].push_back(node);
+  } else if (result == SatResult::Sat)
+    for (const auto &conjunct : node->first)
+      satByConjunct[conjunct.get()].push_back(node);
+  while (entries.size() > capacity)
+    evict();
+}
+
+size_t QueryCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return entries.size();
+}
+
+QueryCacheStats QueryCache::stats() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return counters;
+}
+
+void QueryCache::touch(Entry &entry) {
+  recency.splice(recency.begin(), recency, entry.use);
+}
+
+void QueryCache::evict() {
+  Node *node = recency.back();
+  recency.pop_back();
+  const Key &key = node->first;
+  if (node->second.result == SatResult::Unsat && !key.empty())
+    unindex(unsatByAnchor, node->second.anchor, node);
+  else if (node->second.result == SatResult::Sat)
+    for (const auto &conjunct : key)
+      unindex(satByConjunct, conjunct.get(), node);
+  entries.erase(entries.find(key));
+  ++counters.evictions;
+}
+
+void QueryCache::unindex(Index &index, const BoolExpression *conjunct,
+                         Node *node) {
+  auto it = index.find(conjunct);
+  std::vector<Node *> &nodes = it->second;
+  nodes.erase(std::find(nodes.begin(), nodes.end(), node));
+  if (nodes.empty())
+    index.erase(it);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "Expressions.h"
+#include "Solver.h"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace mysym {
+
+struct QueryCacheStats {
+  size_t exactHits = 0;
+  // a cached unsatisfiable query was a subset of the query
+  size_t unsatSubsetHits = 0;
+  // a cached satisfiable query was a superset of the query
+  size_t satSupersetHits = 0;
+  // a cached model satisfied the query
+  size_t modelHits = 0;
+  size_t misses = 0;
+  // entries dropped to stay within the capacity
+  size_t evictions = 0;
+
+  size_t hits() const {
+    return exactHits + unsatSubsetHits + satSupersetHits + modelHits;
+  }
+};
+
+// Solver answers for sets of conjuncts, in the style of a counterexample
+// cache. Conjuncts are compared by identity, which for nodes from one
+// ExprFactory is structural equality. Besides exact matches, a query is
+// known unsatisfiable if it contains a cached unsatisfiable one, and known
+// satisfiable if it is contained in a cached satisfiable one or a cached
+// model satisfies it. Subset and superset matches go through indexes on the
+// conjuncts of the cached queries, so a lookup only inspects entries that
+// share a conjunct with the query. At most capacity entries are kept; the
+// least recently used one is evicted first, where reusing a model does not
+// count as a use. All members may be called concurrently; cached models are
+// tried on a query without holding the lock.
+class QueryCache {
+public:
+  // conjuncts sorted by address without duplicates
+  using Key = std::vector<std::shared_ptr<BoolExpression>>;
+
+  // A query tries at most scanLimit cached subsets and supersets, newest
+  // first, and only the scanLimit most recently used models.
+  explicit QueryCache(size_t capacity = 4096, size_t scanLimit = 64)
+      : capacity(capacity), scanLimit(scanLimit) {}
+
+  static Key makeKey(std::vector<std::shared_ptr<BoolExpression>> conjuncts);
+
+  // On a Sat hit model, if given, is set to a model of the query.
+  std::optional<SatResult>
+  lookup(const Key &key, std::shared_ptr<const Model> *model = nullptr);
+  void insert(Key key, SatResult result, std::shared_ptr<const Model> model);
+
+  size_t size() const;
+  QueryCacheStats stats() const;
+
+private:
+  struct KeyHash {
+    size_t operator()(const Key &key) const;
+  };
+
+  struct Entry;
+  using Node = std::pair<const Key, Entry>;
+  // the cached entries, most recently used first
+  using Recency = std::list<Node *>;
+
+  struct Entry {
+    SatResult result;
+    std::shared_ptr<const Model> model;
+    Recency::iterator use;
+    // the conjunct an unsatisfiable entry is indexed under
+    const BoolExpression *anchor = nullptr;
+  };
+
+  // Cached entries by the address of their conjuncts: unsatisfiable ones
+  // under the one conjunct that had the fewest entries when they were
+  // added, which keeps the lists scanned for a subset short, and
+  // satisfiable ones under every conjunct.
+  using Index = std::unordered_map<const BoolExpression *, std::vector<Node *>>;
+
+  void touch(Entry &entry);
+  void evict();
+  static void unindex(Index &index, const BoolExpression *conjunct,
+                      Node *node);
+
+  size_t capacity;
+  size_t scanLimit;
+  std::unordered_map<Key, Entry, KeyHash> entries;
+  Recency recency;
+  Index unsatByAnchor;
+  Index satByConjunct;
+  QueryCacheStats counters;
+  mutable std::mutex mutex;
+};
+
+} // namespace mysym
@@ -0,0 +1,203 @@
+#include "Renderer.h"
+#include <algorithm>
+#include <limits>
+
+using namespace mysym;
+
+void Renderer::render(const Expressions &expr, fmt::memory_buffer &out,
+                      ExpressionStyle style) {
+  this->out = &out;
+  names.clear();
+  if (style == ES_Shared)
+    renderShared(expr);
+  else
+    run(expr);
+}
+
+void Renderer::renderShared(const Expressions &expr) {
+  nodes.clear();
+  bound.clear();
+
+  // Counts the references to every node, walking each node once and listing
+  // compound nodes operands first, so that the bindings of operands come
+  // first.
+  pending.emplace_back(&expr, false);
+  while (!pending.empty()) {
+    auto [node, expanded] = pending.back();
+    NodeInfo &info = nodes[node];
+    if (info.done) {
+      pending.pop_back();
+    } else if (expanded) {
+      pending.pop_back();
+      info.done = true;
+      if (info.compound)
+        bound.push_back(node);
+    } else {
+      pending.back().second = true;
+      operands.clear();
+      collectOperands(*node, operands);
+      info.compound = !operands.empty();
+      for (const auto &operand : operands) {
+        NodeInfo &operandInfo = nodes[operand.get()];
+        ++operandInfo.references;
+        if (!operandInfo.done)
+          pending.emplace_back(operand.get(), false);
+      }
+    }
+  }
+  bound.erase(std::remove_if(bound.begin(), bound.end(),
+                             [&](const Expressions *node) {
+                               return nodes[node].references < 2;
+                             }),
+              bound.end());
+
+  if (!bound.empty()) {
+    write("let ");
+    for (size_t index = 0; index < bound.size(); ++index) {
+      if (index)
+        write(", ");
+      writeName(index);
+      write(" = ");
+      run(*bound[index]);
+      names.emplace(bound[index], index);
+    }
+    write(" in ");
+  }
+  run(expr);
+}
+
+void Renderer::run(const Expressions &node) {
+  node.accept(*this);
+  while (!tasks.empty()) {
+    Task task = tasks.back();
+    tasks.pop_back();
+    if (task.text) {
+      write(task.text);
+    } else {
+      auto name = names.find(task.node);
+      if (name != names.end())
+        writeName(name->second);
+      else
+        task.node->accept(*this);
+    }
+  }
+}
+
+void Renderer::write(const char *text) {
+  out->append(text, text + std::char_traits<char>::length(text));
+}
+
+void Renderer::write(int64_t value) {
+  fmt::format_int digits(value);
+  out->append(digits.data(), digits.data() + digits.size());
+}
+
+void Renderer::writeName(size_t index) {
+  out->push_back('#');
+  fmt::format_int digits(index);
+  out->append(digits.data(), digits.data() + digits.size());
+}
+
+void Renderer::writeBinary(const Expressions &lhs, const char *op,
+                           const Expressions &rhs) {
+  out->push_back('(');
+  push(")");
+  push(rhs);
+  push(op);
+  push(lhs);
+}
+
+void Renderer::writeIte(const Expressions &condition,
+                        const Expressions &thenExpr,
+                        const Expressions &elseExpr) {
+  out->push_back('(');
+  push(")");
+  push(elseExpr);
+  push(" : ");
+  push(thenExpr);
+  push(" ? ");
+  push(condition);
+}
+
+void Renderer::writeSummand(int64_t value, bool first) {
+  bool negative = value < 0 && value != std::numeric_limits<int64_t>::min();
+  if (!first)
+    write(negative ? " - " : " + ");
+  else if (negative)
+    out->push_back('-');
+  int64_t magnitude = negative ? -value : value;
+  if (magnitude != 1)
+    write(magnitude);
+}
+
+void Renderer::visitBoolConst(const BoolConst &expr) {
+  write(expr.value ? "true" : "false");
+}
+
+void Renderer::visitBoolSymbol(const BoolSymbol &expr) {
+  out->append(expr.identifier.data(),
+               expr.identifier.data() + expr.identifier.size());
+}
+
+void Renderer::visitBoolNeg(const BoolNeg &expr) {
+  out->push_back('!');
+  push(*expr.subExpr);
+}
+
+void Renderer::visitBoolAnd(const BoolAnd &expr) {
+  writeBinary(*expr.lhs, " & ", *expr.rhs);
+}
+
+void Renderer::visitBoolOr(const BoolOr &expr) {
+  writeBinary(*expr.lhs, " | ", *expr.rhs);
+}
+
+void Renderer::visitBoolIte(const BoolIte &expr) {
+  writeIte(*expr.condition, *expr.thenExpr, *expr.elseExpr);
+}
+
+void Renderer::visitIntLess(const IntLess &expr) {
+  writeBinary(*expr.lhs, " < ", *expr.rhs);
+}
+
+void Renderer::visitIntGreater(const IntGreater &expr) {
+  writeBinary(*expr.lhs, " > ", *expr.rhs);
+}
+
+void Renderer::visitIntConst(const IntConst &expr) { write(expr.value); }
+
+void Renderer::visitIntSymbol(const IntSymbol &expr) {
+  out->append(expr.identifier.data(),
+              expr.identifier.data() + expr.identifier.size());
+}
+
+void Renderer::visitIntAdd(const IntAdd &expr) {
+  writeBinary(*expr.lhs, " + ", *expr.rhs);
+}
+
+void Renderer::visitIntSub(const IntSub &expr) {
+  writeBinary(*expr.lhs, " - ", *expr.rhs);
+}
+
+void Renderer::visitLinearExpr(const LinearExpr &expr) {
+  // symbols are always written in full, so no operand is left for later
+  out->push_back('(');
+  bool first = true;
+  for (const LinearExpr::Term &term : expr.terms) {
+    writeSummand(term.coefficient, first);
+    if (term.coefficient != 1 && term.coefficient != -1)
+      out->push_back('*');
+    visitIntSymbol(*term.symbol);
+    first = false;
+  }
+  if (expr.constant != 0 || first) {
+    writeSummand(expr.constant, first);
+    if (expr.constant == 1 || expr.constant == -1)
+      out->push_back('1');
+  }
+  out->push_back(')');
+}
+
+void Renderer::visitIntIte(const IntIte &expr) {
+  writeIte(*expr.condition, *expr.thenExpr, *expr.elseExpr);
+}
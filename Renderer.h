@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Expressions.h"
+#include "fmt/format.h"
+#include <unordered_map>
+#include <vector>
+
+namespace mysym {
+
+// Does the work of render(), which every textual output of expressions goes
+// through. Never recurses, so deep chains of assignments cannot overflow the
+// stack. Its work stack and tables are kept between calls, and it appends to
+// a buffer the caller reuses, so rendering many expressions allocates next
+// to nothing. Not thread-safe.
+class Renderer : private IExpressionsVisitor {
+public:
+  // Appends expr to out. With ES_Shared, each compound subexpression referred
+  // to more than once is named before the expression itself:
+  //   let #0 = (x + 1), #1 = (#0 < y) in (#1 & !(#0 > 3))
+  // The output then grows with the number of distinct nodes, whereas with
+  // ES_Tree it grows with the expanded tree, exponentially for the ites of
+  // merged paths. Without sharing both write the same.
+  void render(const Expressions &expr, fmt::memory_buffer &out,
+              ExpressionStyle style = ES_Tree);
+
+private:
+  // writes the let-bindings of ES_Shared, then expr
+  void renderShared(const Expressions &expr);
+  // a node to render, or text to write when node is null
+  struct Task {
+    const Expressions *node;
+    const char *text;
+  };
+
+  // Writes node in full and its operands by name where they have one.
+  void run(const Expressions &node);
+  void push(const Expressions &node) { tasks.push_back({&node, nullptr}); }
+  void push(const char *text) { tasks.push_back({nullptr, text}); }
+  void write(const char *text);
+  void write(int64_t value);
+  void writeName(size_t index);
+  void writeBinary(const Expressions &lhs, const char *op,
+                   const Expressions &rhs);
+  void writeIte(const Expressions &condition, const Expressions &thenExpr,
+                const Expressions &elseExpr);
+  // Writes the sign and magnitude of a summand; unit magnitudes are left to
+  // the caller so that 1*x renders as x.
+  void writeSummand(int64_t value, bool first);
+
+  void visitBoolConst(const BoolConst &expr) override;
+  void visitBoolSymbol(const BoolSymbol &expr) override;
+  void visitBoolNeg(const BoolNeg &expr) override;
+  void visitBoolAnd(const BoolAnd &expr) override;
+  void visitBoolOr(const BoolOr &expr) override;
+  void visitBoolIte(const BoolIte &expr) override;
+  void visitIntLess(const IntLess &expr) override;
+  void visitIntGreater(const IntGreater &expr) override;
+  void visitIntConst(const IntConst &expr) override;
+  void visitIntSymbol(const IntSymbol &expr) override;
+  void visitIntAdd(const IntAdd &expr) override;
+  void visitIntSub(const IntSub &expr) override;
+  void visitLinearExpr(const LinearExpr &expr) override;
+  void visitIntIte(const IntIte &expr) override;
+
+  fmt::memory_buffer *out = nullptr;
+  std::vector<Task> tasks;
+  // for renderShared
+  struct NodeInfo {
+    uint32_t references = 0;
+    bool compound = false;
+    bool done = false;
+  };
+  std::unordered_map<const Expressions *, size_t> names;
+  std::unordered_map<const Expressions *, NodeInfo> nodes;
+  // nodes to walk, and whether their operands have been queued
+  std::vector<std::pair<const Expressions *, bool>> pending;
+  std::vector<std::shared_ptr<Expressions>> operands;
+  std::vector<const Expressions *> bound;
+};
+
+} // namespace mysym
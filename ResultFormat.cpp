@@ -0,0 +1,1000 @@
+#include "ResultFormat.h"
+#include "cereal/archives/json.hpp"
+#include "cereal/external/rapidjson/stringbuffer.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <iterator>
+#include <ostream>
+#include <stdexcept>
+#include <unordered_map>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace mysym;
+
+namespace {
+
+// Laid out as cereal writes the vector of results, which uses the same
+// writer and indentation.
+class JsonWriter : public ResultWriter {
+public:
+  JsonWriter(std::ostream &out, ExpressionStyle style)
+      : ResultWriter(out), stream(out), writer(stream), style(style) {
+    writer.SetIndent(' ', 4);
+    writer.StartArray();
+  }
+  ~JsonWriter() override { finishQuietly(); }
+
+  // flushed like NdJsonWriter, so that readers of a pipe see every result
+  // as soon as it is found
+  void accept(SymbolicExecutionResult result) override {
+    writer.StartObject();
+    result.writeFields(writer, style);
+    writer.EndObject();
+    writer.Flush();
+  }
+
+private:
+  void writeEnd() override {
+    writer.EndArray();
+    writer.Flush();
+  }
+
+  rapidjson::OStreamWrapper stream;
+  rapidjson::PrettyWriter<rapidjson::OStreamWrapper> writer;
+  ExpressionStyle style;
+};
+
+// Every line is a document of its own, built in a buffer by the compact
+// writer and written with a single call.
+class NdJsonWriter : public ResultWriter {
+public:
+  NdJsonWriter(std::ostream &out, ExpressionStyle style)
+      : ResultWriter(out), writer(buffer), style(style) {}
+
+  void accept(SymbolicExecutionResult result) override {
+    buffer.Clear();
+    writer.Reset(buffer);
+    writer.StartObject();
+    result.writeFields(writer, style);
+    writer.EndObject();
+    buffer.Put('\n');
+    out.write(buffer.GetString(), buffer.GetSize());
+    out.flush();
+  }
+
+private:
+  rapidjson::StringBuffer buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> writer;
+  ExpressionStyle style;
+};
+
+// RF_Binary starts with the magic and the version, followed by records. A
+// record is a byte giving its kind and a payload of unsigned LEB128 varints,
+// signed numbers being zigzag encoded first. Names and nodes are numbered in
+// the order they are defined, and a node refers to another one by how many
+// nodes back it was defined, which keeps references short. No record refers
+// to a later one.
+const char BinaryMagic[8] = {'m', 'y', 's', 'y', 'm', 'b', 'i', 'n'};
+constexpr uint64_t BinaryVersion = 1;
+
+enum BinaryRecord : uint8_t {
+  // length and bytes of the next name
+  BR_Name = 1,
+  // number of values, then the name and node of each, the path condition and
+  // the result
+  BR_Result,
+  // nodes, followed by what their constructor takes
+  BR_BoolConst,
+  BR_BoolSymbol,
+  BR_BoolNeg,
+  BR_BoolAnd,
+  BR_BoolOr,
+  BR_BoolIte,
+  BR_IntLess,
+  BR_IntGreater,
+  BR_IntConst,
+  BR_IntSymbol,
+  BR_IntAdd,
+  BR_IntSub,
+  // number of terms, the symbol and coefficient of each, then the constant
+  BR_LinearExpr,
+  BR_IntIte,
+};
+
+// The nodes written so far and what identifies them in the output. Holding
+// the nodes keeps their addresses from being reused by nodes not written
+// yet.
+class NodeTable {
+public:
+  // Returns the identifier of root. Nodes under it not written yet are
+  // written first, operands before the nodes referring to them, by calling
+  // write, which returns the identifier of the node it writes. Iterative, as
+  // chains of assignments make deep expressions.
+  template <typename Write>
+  uint64_t define(const std::shared_ptr<Expressions> &root, Write write) {
+    pending.emplace_back(root, false);
+    while (!pending.empty()) {
+      auto [node, expanded] = pending.back();
+      if (nodes.count(node)) {
+        pending.pop_back();
+      } else if (expanded) {
+        pending.pop_back();
+        uint64_t id = write(*node);
+        nodes.emplace(std::move(node), id);
+      } else {
+        pending.back().second = true;
+        operands.clear();
+        collectOperands(*node, operands);
+        for (auto &operand : operands)
+          if (!nodes.count(operand))
+            pending.emplace_back(std::move(operand), false);
+      }
+    }
+    return nodes.at(root);
+  }
+
+  uint64_t at(const std::shared_ptr<Expressions> &node) const {
+    return nodes.at(node);
+  }
+  size_t size() const { return nodes.size(); }
+
+private:
+  std::unordered_map<std::shared_ptr<Expressions>, uint64_t> nodes;
+  // nodes to write, and whether their operands have been queued
+  std::vector<std::pair<std::shared_ptr<Expressions>, bool>> pending;
+  std::vector<std::shared_ptr<Expressions>> operands;
+};
+
+class BinaryWriter : public ResultWriter, private IExpressionsVisitor {
+public:
+  explicit BinaryWriter(std::ostream &out) : ResultWriter(out) {
+    out.write(BinaryMagic, sizeof(BinaryMagic));
+    writeVarint(BinaryVersion);
+    flush();
+  }
+
+  void accept(SymbolicExecutionResult result) override {
+    std::vector<std::pair<uint64_t, uint64_t>> values;
+    for (size_t index = 0; index < result.memory.size(); ++index)
+      values.emplace_back(nameIndex(result.memory.name(index)),
+                          define(result.memory.get(index)));
+    uint64_t pc = define(result.pc);
+    uint64_t value = define(result.result);
+
+    buffer.push_back(BR_Result);
+    writeVarint(values.size());
+    for (auto [name, node] : values) {
+      writeVarint(name);
+      writeReference(node);
+    }
+    writeReference(pc);
+    writeReference(value);
+    flush();
+  }
+
+private:
+  void flush() {
+    out.write(buffer.data(), buffer.size());
+    buffer.clear();
+  }
+
+  void writeVarint(uint64_t value) {
+    for (; value >= 0x80; value >>= 7)
+      buffer.push_back(static_cast<char>(value | 0x80));
+    buffer.push_back(static_cast<char>(value));
+  }
+
+  void writeSigned(int64_t value) {
+    writeVarint((static_cast<uint64_t>(value) << 1) ^
+                static_cast<uint64_t>(value >> 63));
+  }
+
+  void writeReference(uint64_t node) { writeVarint(nodes.size() - node); }
+  void writeOperand(const std::shared_ptr<Expressions> &operand) {
+    writeReference(nodes.at(operand));
+  }
+
+  // nodes are numbered in the order they are written
+  uint64_t define(const std::shared_ptr<Expressions> &root) {
+    return nodes.define(root, [this](const Expressions &node) {
+      uint64_t id = nodes.size();
+      node.accept(*this);
+      return id;
+    });
+  }
+
+  // The index of a name, defining it first if needed.
+  uint64_t nameIndex(const std::string &name) {
+    auto [it, inserted] = names.emplace(name, names.size());
+    if (inserted) {
+      buffer.push_back(BR_Name);
+      writeVarint(name.size());
+      buffer.append(name);
+    }
+    return it->second;
+  }
+
+  template <typename... T>
+  void writeNode(BinaryRecord record, const std::shared_ptr<T> &...operand) {
+    buffer.push_back(record);
+    (writeOperand(operand), ...);
+  }
+
+  void visitBoolConst(const BoolConst &expr) override {
+    buffer.push_back(BR_BoolConst);
+    writeVarint(expr.value);
+  }
+  void visitBoolSymbol(const BoolSymbol &expr) override {
+    uint64_t identifier = nameIndex(expr.identifier);
+    buffer.push_back(BR_BoolSymbol);
+    writeVarint(identifier);
+    writeVarint(expr.id);
+  }
+  void visitBoolNeg(const BoolNeg &expr) override {
+    writeNode(BR_BoolNeg, expr.subExpr);
+  }
+  void visitBoolAnd(const BoolAnd &expr) override {
+    writeNode(BR_BoolAnd, expr.lhs, expr.rhs);
+  }
+  void visitBoolOr(const BoolOr &expr) override {
+    writeNode(BR_BoolOr, expr.lhs, expr.rhs);
+  }
+  void visitBoolIte(const BoolIte &expr) override {
+    writeNode(BR_BoolIte, expr.condition, expr.thenExpr, expr.elseExpr);
+  }
+  void visitIntLess(const IntLess &expr) override {
+    writeNode(BR_IntLess, expr.lhs, expr.rhs);
+  }
+  void visitIntGreater(const IntGreater &expr) override {
+    writeNode(BR_IntGreater, expr.lhs, expr.rhs);
+  }
+  void visitIntConst(const IntConst &expr) override {
+    buffer.push_back(BR_IntConst);
+    writeSigned(expr.value);
+  }
+  void visitIntSymbol(const IntSymbol &expr) override {
+    uint64_t identifier = nameIndex(expr.identifier);
+    buffer.push_back(BR_IntSymbol);
+    writeVarint(identifier);
+    writeVarint(expr.id);
+  }
+  void visitIntAdd(const IntAdd &expr) override {
+    writeNode(BR_IntAdd, expr.lhs, expr.rhs);
+  }
+  void visitIntSub(const IntSub &expr) override {
+    writeNode(BR_IntSub, expr.lhs, expr.rhs);
+  }
+  void visitLinearExpr(const LinearExpr &expr) override {
+    buffer.push_back(BR_LinearExpr);
+    writeVarint(expr.terms.size());
+    for (const LinearExpr::Term &term : expr.terms) {
+      writeOperand(term.symbol);
+      writeSigned(term.coefficient);
+    }
+    writeSigned(expr.constant);
+  }
+  void visitIntIte(const IntIte &expr) override {
+    writeNode(BR_IntIte, expr.condition, expr.thenExpr, expr.elseExpr);
+  }
+
+  // the records of the current result
+  std::string buffer;
+  std::unordered_map<std::string, uint64_t> names;
+  NodeTable nodes;
+};
+
+// RF_Indexed is made of 64-bit words in the byte order of the writer:
+// - the header: the magic, then the version and 32 unused bits;
+// - the records, each starting with its StoredNodeKind and its size in words
+//   as 32-bit halves of a word. A node refers to earlier records by their
+//   offset in the file. A name record gives its length in bytes instead,
+//   followed by the bytes padded to a word;
+// - the offsets of the names of the parameters;
+// - the index: for every path, the offsets of its path condition, of its
+//   result and of its values, one for each parameter;
+// - the footer: the offsets of the parameter names and of the index, the
+//   number of parameters, the number of paths and the magic again.
+// Writing the index last lets the file be streamed like the other formats.
+const char IndexedMagic[8] = {'m', 'y', 's', 'y', 'm', 'i', 'd', 'x'};
+constexpr uint32_t IndexedVersion = 1;
+constexpr uint64_t IndexedHeaderSize = 16;
+constexpr uint64_t IndexedFooterSize = 40;
+
+class IndexedWriter : public ResultWriter, private IExpressionsVisitor {
+public:
+  explicit IndexedWriter(std::ostream &out) : ResultWriter(out) {
+    buffer.append(IndexedMagic, sizeof(IndexedMagic));
+    writeHalves(IndexedVersion, 0);
+    flush();
+  }
+
+  ~IndexedWriter() override { finishQuietly(); }
+
+  void accept(SymbolicExecutionResult result) override {
+    const SymbolicMemory &memory = result.memory;
+    if (paths == 0)
+      for (size_t slot = 0; slot < memory.size(); ++slot)
+        parameters.push_back(nameOffset(memory.name(slot)));
+    else if (memory.size() != parameters.size())
+      throw std::runtime_error("results of different functions in one file");
+
+    index.push_back(define(result.pc));
+    index.push_back(define(result.result));
+    for (size_t slot = 0; slot < memory.size(); ++slot)
+      index.push_back(define(memory.get(slot)));
+    ++paths;
+    flush();
+  }
+
+private:
+  void writeEnd() override {
+    uint64_t parametersOffset = written;
+    for (uint64_t name : parameters)
+      writeWord(name);
+    flush();
+    uint64_t indexOffset = written;
+    out.write(reinterpret_cast<const char *>(index.data()),
+              index.size() * sizeof(uint64_t));
+    written += index.size() * sizeof(uint64_t);
+    writeWord(parametersOffset);
+    writeWord(indexOffset);
+    writeWord(parameters.size());
+    writeWord(paths);
+    buffer.append(IndexedMagic, sizeof(IndexedMagic));
+    flush();
+  }
+
+  void flush() {
+    out.write(buffer.data(), buffer.size());
+    written += buffer.size();
+    buffer.clear();
+  }
+
+  void writeWord(uint64_t word) {
+    buffer.append(reinterpret_cast<const char *>(&word), sizeof(word));
+  }
+
+  void writeHalves(uint32_t low, uint32_t high) {
+    buffer.append(reinterpret_cast<const char *>(&low), sizeof(low));
+    buffer.append(reinterpret_cast<const char *>(&high), sizeof(high));
+  }
+
+  uint64_t offset() const { return written + buffer.size(); }
+
+  void beginRecord(StoredNodeKind kind, size_t words) {
+    recordOffset = offset();
+    writeHalves(kind, words);
+  }
+
+  // The offset of a name, writing it first if needed.
+  uint64_t nameOffset(const std::string &name) {
+    auto [it, inserted] = names.emplace(name, offset());
+    if (inserted) {
+      writeHalves(SN_Name, name.size());
+      buffer.append(name);
+      buffer.append(-name.size() % sizeof(uint64_t), '\0');
+    }
+    return it->second;
+  }
+
+  // nodes are identified by the offset of their record
+  uint64_t define(const std::shared_ptr<Expressions> &root) {
+    return nodes.define(root, [this](const Expressions &node) {
+      node.accept(*this);
+      return recordOffset;
+    });
+  }
+
+  template <typename... T>
+  void writeNode(StoredNodeKind kind, const std::shared_ptr<T> &...operand) {
+    beginRecord(kind, sizeof...(operand));
+    (writeWord(nodes.at(operand)), ...);
+  }
+
+  void writeSymbol(StoredNodeKind kind, const std::string &identifier,
+                   uint32_t id) {
+    uint64_t name = nameOffset(identifier);
+    beginRecord(kind, 2);
+    writeWord(name);
+    writeWord(id);
+  }
+
+  void visitBoolConst(const BoolConst &expr) override {
+    beginRecord(SN_BoolConst, 1);
+    writeWord(expr.value);
+  }
+  void visitBoolSymbol(const BoolSymbol &expr) override {
+    writeSymbol(SN_BoolSymbol, expr.identifier, expr.id);
+  }
+  void visitBoolNeg(const BoolNeg &expr) override {
+    writeNode(SN_BoolNeg, expr.subExpr);
+  }
+  void visitBoolAnd(const BoolAnd &expr) override {
+    writeNode(SN_BoolAnd, expr.lhs, expr.rhs);
+  }
+  void visitBoolOr(const BoolOr &expr) override {
+    writeNode(SN_BoolOr, expr.lhs, expr.rhs);
+  }
+  void visitBoolIte(const BoolIte &expr) override {
+    writeNode(SN_BoolIte, expr.condition, expr.thenExpr, expr.elseExpr);
+  }
+  void visitIntLess(const IntLess &expr) override {
+    writeNode(SN_IntLess, expr.lhs, expr.rhs);
+  }
+  void visitIntGreater(const IntGreater &expr) override {
+    writeNode(SN_IntGreater, expr.lhs, expr.rhs);
+  }
+  void visitIntConst(const IntConst &expr) override {
+    beginRecord(SN_IntConst, 1);
+    writeWord(static_cast<uint64_t>(expr.value));
+  }
+  void visitIntSymbol(const IntSymbol &expr) override {
+    writeSymbol(SN_IntSymbol, expr.identifier, expr.id);
+  }
+  void visitIntAdd(const IntAdd &expr) override {
+    writeNode(SN_IntAdd, expr.lhs, expr.rhs);
+  }
+  void visitIntSub(const IntSub &expr) override {
+    writeNode(SN_IntSub, expr.lhs, expr.rhs);
+  }
+  void visitLinearExpr(const LinearExpr &expr) override {
+    beginRecord(SN_LinearExpr, 2 * expr.terms.size() + 1);
+    for (const LinearExpr::Term &term : expr.terms) {
+      writeWord(nodes.at(term.symbol));
+      writeWord(static_cast<uint64_t>(term.coefficient));
+    }
+    writeWord(static_cast<uint64_t>(expr.constant));
+  }
+  void visitIntIte(const IntIte &expr) override {
+    writeNode(SN_IntIte, expr.condition, expr.thenExpr, expr.elseExpr);
+  }
+
+  // bytes passed to out so far
+  uint64_t written = 0;
+  // the records of the current result
+  std::string buffer;
+  uint64_t recordOffset = 0;
+  std::unordered_map<std::string, uint64_t> names;
+  NodeTable nodes;
+  std::vector<uint64_t> parameters;
+  // The entries of the paths so far; a few words for each, while the nodes
+  // of the paths are held by nodes anyway.
+  std::vector<uint64_t> index;
+  uint64_t paths = 0;
+};
+
+} // namespace
+
+std::unique_ptr<ResultWriter> ResultWriter::create(ResultFormat format,
+                                                   std::ostream &out,
+                                                   ExpressionStyle style) {
+  switch (format) {
+  case RF_Json:
+    return std::make_unique<JsonWriter>(out, style);
+  case RF_NdJson:
+    return std::make_unique<NdJsonWriter>(out, style);
+  case RF_Binary:
+    return std::make_unique<BinaryWriter>(out);
+  case RF_Indexed:
+    return std::make_unique<IndexedWriter>(out);
+  }
+  throw std::runtime_error("unknown result format");
+}
+
+void ResultWriter::finish() {
+  if (!finished) {
+    finished = true;
+    writeEnd();
+    out.flush();
+  }
+  if (!out)
+    throw std::runtime_error("could not write results");
+}
+
+void ResultWriter::finishQuietly() noexcept {
+  try {
+    finish();
+  } catch (...) {
+  }
+}
+
+static std::runtime_error malformed() {
+  return std::runtime_error("malformed result file");
+}
+
+ResultReader::ResultReader(std::istream &in) : in(*in.rdbuf()) {
+  char magic[sizeof(BinaryMagic)];
+  if (this->in.sgetn(magic, sizeof(magic)) != sizeof(magic) ||
+      !std::equal(magic, magic + sizeof(magic), BinaryMagic))
+    throw std::runtime_error("not a result file");
+  if (readVarint() != BinaryVersion)
+    throw std::runtime_error("unsupported result file version");
+}
+
+bool ResultReader::next(StoredResult &result) {
+  while (true) {
+    int record = in.sbumpc();
+    switch (record) {
+    case std::streambuf::traits_type::eof():
+      return false;
+    case BR_Name: {
+      // the length is untrusted: grow the name only by bytes actually read
+      uint64_t length = readVarint();
+      std::string name;
+      char chunk[256];
+      while (length > 0) {
+        std::streamsize size = std::min<uint64_t>(length, sizeof(chunk));
+        if (in.sgetn(chunk, size) != size)
+          throw malformed();
+        name.append(chunk, size);
+        length -= size;
+      }
+      names.push_back(std::move(name));
+      break;
+    }
+    case BR_Result: {
+      uint64_t count = readVarint();
+      result.values.clear();
+      for (uint64_t index = 0; index < count; ++index) {
+        const std::string &name = readName();
+        result.values.emplace_back(name, readReference());
+      }
+      result.pc = readReference<BoolExpression>();
+      result.result = readReference();
+      return true;
+    }
+    default:
+      nodes.push_back(readNode(record));
+      break;
+    }
+  }
+}
+
+uint64_t ResultReader::readVarint() {
+  uint64_t value = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    int byte = in.sbumpc();
+    if (byte == std::streambuf::traits_type::eof())
+      throw malformed();
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return value;
+  }
+  throw malformed();
+}
+
+int64_t ResultReader::readSigned() {
+  uint64_t value = readVarint();
+  return static_cast<int64_t>((value >> 1) ^ (~(value & 1) + 1));
+}
+
+const std::string &ResultReader::readName() {
+  uint64_t index = readVarint();
+  if (index >= names.size())
+    throw malformed();
+  return names[index];
+}
+
+std::shared_ptr<Expressions> ResultReader::readReference() {
+  uint64_t back = readVarint();
+  if (back == 0 || back > nodes.size())
+    throw malformed();
+  return nodes[nodes.size() - back];
+}
+
+template <typename T> std::shared_ptr<T> ResultReader::readReference() {
+  auto node = std::dynamic_pointer_cast<T>(readReference());
+  if (!node)
+    throw malformed();
+  return node;
+}
+
+std::shared_ptr<Expressions> ResultReader::readNode(int record) {
+  switch (record) {
+  case BR_BoolConst:
+    return std::make_shared<BoolConst>(readVarint() != 0);
+  case BR_BoolSymbol: {
+    const std::string &identifier = readName();
+    return std::make_shared<BoolSymbol>(identifier, readVarint());
+  }
+  case BR_BoolNeg:
+    return std::make_shared<BoolNeg>(readReference<BoolExpression>());
+  case BR_BoolAnd: {
+    auto lhs = readReference<BoolExpression>();
+    return std::make_shared<BoolAnd>(lhs, readReference<BoolExpression>());
+  }
+  case BR_BoolOr: {
+    auto lhs = readReference<BoolExpression>();
+    return std::make_shared<BoolOr>(lhs, readReference<BoolExpression>());
+  }
+  case BR_BoolIte: {
+    auto condition = readReference<BoolExpression>();
+    auto thenExpr = readReference<BoolExpression>();
+    return std::make_shared<BoolIte>(condition, thenExpr,
+                                     readReference<BoolExpression>());
+  }
+  case BR_IntLess: {
+    auto lhs = readReference<IntExpression>();
+    return std::make_shared<IntLess>(lhs, readReference<IntExpression>());
+  }
+  case BR_IntGreater: {
+    auto lhs = readReference<IntExpression>();
+    return std::make_shared<IntGreater>(lhs, readReference<IntExpression>());
+  }
+  case BR_IntConst:
+    return std::make_shared<IntConst>(readSigned());
+  case BR_IntSymbol: {
+    const std::string &identifier = readName();
+    return std::make_shared<IntSymbol>(identifier, readVarint());
+  }
+  case BR_IntAdd: {
+    auto lhs = readReference<IntExpression>();
+    return std::make_shared<IntAdd>(lhs, readReference<IntExpression>());
+  }
+  case BR_IntSub: {
+    auto lhs = readReference<IntExpression>();
+    return std::make_shared<IntSub>(lhs, readReference<IntExpression>());
+  }
+  case BR_LinearExpr: {
+    uint64_t count = readVarint();
+    // the symbols of the terms are distinct nodes
+    if (count > nodes.size())
+      throw malformed();
+    std::vector<LinearExpr::Term> terms(count);
+    for (LinearExpr::Term &term : terms) {
+      term.symbol = readReference<IntSymbol>();
+      term.coefficient = readSigned();
+    }
+    return std::make_shared<LinearExpr>(std::move(terms), readSigned());
+  }
+  case BR_IntIte: {
+    auto condition = readReference<BoolExpression>();
+    auto thenExpr = readReference<IntExpression>();
+    return std::make_shared<IntIte>(condition, thenExpr,
+                                    readReference<IntExpression>());
+  }
+  }
+  throw malformed();
+}
+
+template <typename T>
+static std::shared_ptr<T> as(const std::shared_ptr<Expressions> &node) {
+  auto typed = std::dynamic_pointer_cast<T>(node);
+  if (!typed)
+    throw malformed();
+  return typed;
+}
+
+static std::runtime_error wrongKind() {
+  return std::runtime_error("no such part in this kind of stored node");
+}
+
+StoredNode::StoredNode(const ResultFile &file, uint64_t position)
+    : file(&file), position(position) {
+  if (position % sizeof(uint64_t) || position < IndexedHeaderSize ||
+      position >= file.recordsEnd)
+    throw malformed();
+  uint64_t header = file.word(position);
+  std::memcpy(&type, &header, sizeof(type));
+  std::memcpy(&words, reinterpret_cast<const char *>(&header) + sizeof(type),
+              sizeof(words));
+  if (words > (file.recordsEnd - position) / sizeof(uint64_t) - 1)
+    throw malformed();
+  bool valid = false;
+  switch (type) {
+  case SN_BoolConst:
+  case SN_BoolNeg:
+  case SN_IntConst:
+    valid = words == 1;
+    break;
+  case SN_BoolSymbol:
+  case SN_BoolAnd:
+  case SN_BoolOr:
+  case SN_IntLess:
+  case SN_IntGreater:
+  case SN_IntSymbol:
+  case SN_IntAdd:
+  case SN_IntSub:
+    valid = words == 2;
+    break;
+  case SN_BoolIte:
+  case SN_IntIte:
+    valid = words == 3;
+    break;
+  case SN_LinearExpr:
+    valid = words % 2 == 1;
+    break;
+  }
+  if (!valid)
+    throw malformed();
+}
+
+uint64_t StoredNode::word(size_t index) const {
+  return file->word(position + (index + 1) * sizeof(uint64_t));
+}
+
+StoredNode StoredNode::reference(size_t index) const {
+  // records only refer to earlier ones, so nodes form a DAG
+  uint64_t offset = word(index);
+  if (offset >= position)
+    throw malformed();
+  return StoredNode(*file, offset);
+}
+
+size_t StoredNode::operandCount() const {
+  switch (type) {
+  case SN_BoolNeg:
+  case SN_BoolAnd:
+  case SN_BoolOr:
+  case SN_BoolIte:
+  case SN_IntLess:
+  case SN_IntGreater:
+  case SN_IntAdd:
+  case SN_IntSub:
+  case SN_IntIte:
+    return words;
+  }
+  return 0;
+}
+
+StoredNode StoredNode::operand(size_t index) const {
+  if (index >= operandCount())
+    throw wrongKind();
+  return reference(index);
+}
+
+int64_t StoredNode::value() const {
+  if (type != SN_BoolConst && type != SN_IntConst)
+    throw wrongKind();
+  return static_cast<int64_t>(word(0));
+}
+
+std::string_view StoredNode::identifier() const {
+  if (type != SN_BoolSymbol && type != SN_IntSymbol)
+    throw wrongKind();
+  return file->name(word(0));
+}
+
+uint32_t StoredNode::symbolId() const {
+  if (type != SN_BoolSymbol && type != SN_IntSymbol)
+    throw wrongKind();
+  return static_cast<uint32_t>(word(1));
+}
+
+size_t StoredNode::termCount() const {
+  return type == SN_LinearExpr ? words / 2 : 0;
+}
+
+StoredNode StoredNode::termSymbol(size_t index) const {
+  if (index >= termCount())
+    throw wrongKind();
+  return reference(2 * index);
+}
+
+int64_t StoredNode::termCoefficient(size_t index) const {
+  if (index >= termCount())
+    throw wrongKind();
+  return static_cast<int64_t>(word(2 * index + 1));
+}
+
+int64_t StoredNode::constant() const {
+  if (type != SN_LinearExpr)
+    throw wrongKind();
+  return static_cast<int64_t>(word(words - 1));
+}
+
+ResultFile::ResultFile(const std::string &path) {
+#if defined(__unix__) || defined(__APPLE__)
+  int descriptor = ::open(path.c_str(), O_RDONLY);
+  if (descriptor < 0)
+    throw std::runtime_error("cannot open " + path);
+  struct stat status;
+  if (fstat(descriptor, &status) == 0 && status.st_size > 0) {
+    length = status.st_size;
+    void *address =
+        mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    if (address != MAP_FAILED) {
+      data = static_cast<const char *>(address);
+      mapped = true;
+    }
+  }
+  ::close(descriptor);
+#endif
+  if (!mapped) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+      throw std::runtime_error("cannot open " + path);
+    contents.assign(std::istreambuf_iterator<char>(in),
+                    std::istreambuf_iterator<char>());
+    data = contents.data();
+    length = contents.size();
+  }
+
+  uint32_t version = 0;
+  if (length >= IndexedHeaderSize + IndexedFooterSize)
+    std::memcpy(&version, data + sizeof(IndexedMagic), sizeof(version));
+  if (length % sizeof(uint64_t) ||
+      length < IndexedHeaderSize + IndexedFooterSize ||
+      !std::equal(IndexedMagic, IndexedMagic + sizeof(IndexedMagic), data) ||
+      !std::equal(IndexedMagic, IndexedMagic + sizeof(IndexedMagic),
+                  data + length - sizeof(IndexedMagic)) ||
+      version != IndexedVersion) {
+    unmap();
+    throw std::runtime_error(path + " is not an indexed result file");
+  }
+
+  uint64_t footer = length - IndexedFooterSize;
+  recordsEnd = word(footer);
+  indexOffset = word(footer + 8);
+  uint64_t parameterWords = word(footer + 16);
+  uint64_t pathCount = word(footer + 24);
+  // every word of the index belongs to one path
+  uint64_t entryBytes = (parameterWords + 2) * sizeof(uint64_t);
+  if (recordsEnd < IndexedHeaderSize || recordsEnd > indexOffset ||
+      indexOffset > footer || recordsEnd % sizeof(uint64_t) ||
+      indexOffset % sizeof(uint64_t) ||
+      parameterWords != (indexOffset - recordsEnd) / sizeof(uint64_t) ||
+      pathCount != (footer - indexOffset) / entryBytes ||
+      (footer - indexOffset) % entryBytes) {
+    unmap();
+    throw malformed();
+  }
+  parameters = parameterWords;
+  paths = pathCount;
+}
+
+ResultFile::~ResultFile() { unmap(); }
+
+void ResultFile::unmap() {
+#if defined(__unix__) || defined(__APPLE__)
+  if (mapped)
+    munmap(const_cast<char *>(data), length);
+#endif
+  mapped = false;
+}
+
+uint64_t ResultFile::word(uint64_t offset) const {
+  uint64_t word;
+  std::memcpy(&word, data + offset, sizeof(word));
+  return word;
+}
+
+uint64_t ResultFile::entry(size_t path, size_t field) const {
+  if (path >= paths)
+    throw std::runtime_error("no such path");
+  size_t index = path * (parameters + 2) + field;
+  return word(indexOffset + index * sizeof(uint64_t));
+}
+
+std::string_view ResultFile::name(uint64_t offset) const {
+  if (offset % sizeof(uint64_t) || offset < IndexedHeaderSize ||
+      offset >= recordsEnd)
+    throw malformed();
+  uint64_t header = word(offset);
+  uint32_t kind;
+  uint32_t size;
+  std::memcpy(&kind, &header, sizeof(kind));
+  std::memcpy(&size, reinterpret_cast<const char *>(&header) + sizeof(kind),
+              sizeof(size));
+  if (kind != SN_Name || size > recordsEnd - offset - sizeof(uint64_t))
+    throw malformed();
+  return std::string_view(data + offset + sizeof(uint64_t), size);
+}
+
+std::string_view ResultFile::parameterName(size_t index) const {
+  if (index >= parameters)
+    throw std::runtime_error("no such parameter");
+  return name(word(recordsEnd + index * sizeof(uint64_t)));
+}
+
+StoredNode ResultFile::pc(size_t path) const {
+  return StoredNode(*this, entry(path, 0));
+}
+
+StoredNode ResultFile::result(size_t path) const {
+  return StoredNode(*this, entry(path, 1));
+}
+
+StoredNode ResultFile::value(size_t path, size_t parameter) const {
+  if (parameter >= parameters)
+    throw std::runtime_error("no such parameter");
+  return StoredNode(*this, entry(path, parameter + 2));
+}
+
+std::shared_ptr<Expressions> ResultFile::load(StoredNode root) {
+  if (root.file != this)
+    throw std::runtime_error("node of another result file");
+  // operands first, without recursing
+  std::vector<std::pair<StoredNode, bool>> pending{{root, false}};
+  while (!pending.empty()) {
+    auto [node, expanded] = pending.back();
+    if (loaded.count(node.offset())) {
+      pending.pop_back();
+    } else if (expanded) {
+      pending.pop_back();
+      loaded.emplace(node.offset(), build(node));
+    } else {
+      pending.back().second = true;
+      for (size_t index = 0; index < node.operandCount(); ++index)
+        pending.emplace_back(node.operand(index), false);
+      for (size_t index = 0; index < node.termCount(); ++index)
+        pending.emplace_back(node.termSymbol(index), false);
+    }
+  }
+  return loaded.at(root.offset());
+}
+
+StoredResult ResultFile::load(size_t path) {
+  StoredResult stored;
+  for (size_t parameter = 0; parameter < parameters; ++parameter)
+    stored.values.emplace_back(parameterName(parameter),
+                               load(value(path, parameter)));
+  stored.pc = as<BoolExpression>(load(pc(path)));
+  stored.result = load(result(path));
+  return stored;
+}
+
+std::shared_ptr<Expressions> ResultFile::build(StoredNode node) {
+  auto operand = [&](size_t index) {
+    return loaded.at(node.operand(index).offset());
+  };
+  switch (node.kind()) {
+  case SN_BoolConst:
+    return std::make_shared<BoolConst>(node.value() != 0);
+  case SN_BoolSymbol:
+    return std::make_shared<BoolSymbol>(std::string(node.identifier()),
+                                        node.symbolId());
+  case SN_BoolNeg:
+    return std::make_shared<BoolNeg>(as<BoolExpression>(operand(0)));
+  case SN_BoolAnd:
+    return std::make_shared<BoolAnd>(as<BoolExpression>(operand(0)),
+                                     as<BoolExpression>(operand(1)));
+  case SN_BoolOr:
+    return std::make_shared<BoolOr>(as<BoolExpression>(operand(0)),
+                                    as<BoolExpression>(operand(1)));
+  case SN_BoolIte:
+    return std::make_shared<BoolIte>(as<BoolExpression>(operand(0)),
+                                     as<BoolExpression>(operand(1)),
+                                     as<BoolExpression>(operand(2)));
+  case SN_IntLess:
+    return std::make_shared<IntLess>(as<IntExpression>(operand(0)),
+                                     as<IntExpression>(operand(1)));
+  case SN_IntGreater:
+    return std::make_shared<IntGreater>(as<IntExpression>(operand(0)),
+                                        as<IntExpression>(operand(1)));
+  case SN_IntConst:
+    return std::make_shared<IntConst>(node.value());
+  case SN_IntSymbol:
+    return std::make_shared<IntSymbol>(std::string(node.identifier()),
+                                       node.symbolId());
+  case SN_IntAdd:
+    return std::make_shared<IntAdd>(as<IntExpression>(operand(0)),
+                                    as<IntExpression>(operand(1)));
+  case SN_IntSub:
+    return std::make_shared<IntSub>(as<IntExpression>(operand(0)),
+                                    as<IntExpression>(operand(1)));
+  case SN_LinearExpr: {
+    std::vector<LinearExpr::Term> terms(node.termCount());
+    for (size_t index = 0; index < terms.size(); ++index) {
+      terms[index].symbol =
+          as<IntSymbol>(loaded.at(node.termSymbol(index).offset()));
+      terms[index].coefficient = node.termCoefficient(index);
+    }
+    return std::make_shared<LinearExpr>(std::move(terms), node.constant());
+  }
+  case SN_IntIte:
+    return std::make_shared<IntIte>(as<BoolExpression>(operand(0)),
+                                    as<IntExpression>(operand(1)),
+                                    as<IntExpression>(operand(2)));
+  case SN_Name:
+    break;
+  }
+  throw malformed();
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include "Interpreter.h"
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace mysym {
+
+enum ResultFormat {
+  // one JSON array holding every result, as cereal::save writes the vector
+  RF_Json,
+  // One JSON object per line, flushed as soon as it is written, so that
+  // readers can process paths while execution goes on.
+  RF_NdJson,
+  // Binary, read back with ResultReader. Every distinct expression node is
+  // written once, the first time a result refers to it, and is referred to
+  // by its index from then on, so subexpressions shared between values,
+  // path conditions and results take no space after their first use. The
+  // writer keeps every node it has written until it is destroyed, so its
+  // memory grows with the distinct nodes of the output.
+  RF_Binary,
+  // Random access file, read with ResultFile. Holds the distinct nodes, as
+  // RF_Binary does, and a table with an entry of the same size for every
+  // path, so that a path can be found without reading the ones before it.
+  RF_Indexed,
+};
+
+// Writes results to a stream as they are accepted. The output is complete
+// once finish() has been called. style applies to the JSON formats; the
+// binary ones always share subexpressions.
+class ResultWriter : public IResultSink {
+public:
+  static std::unique_ptr<ResultWriter>
+  create(ResultFormat format, std::ostream &out,
+         ExpressionStyle style = ES_Tree);
+
+  // Writes what follows the last result and flushes the stream. Throws
+  // std::runtime_error if the stream failed at any point. Nothing may be
+  // accepted afterwards. A writer destroyed without it finishes the output
+  // anyway, but can only ignore errors.
+  void finish();
+
+protected:
+  explicit ResultWriter(std::ostream &out) : out(out) {}
+
+  // Called once, by finish() or by the destructor of the writer.
+  virtual void writeEnd() {}
+  void finishQuietly() noexcept;
+
+  std::ostream &out;
+
+private:
+  bool finished = false;
+};
+
+// A result read back from a file. Values are named by the parameter they
+// belong to, as the function itself is not at hand.
+struct StoredResult {
+  std::vector<std::pair<std::string, std::shared_ptr<Expressions>>> values;
+  std::shared_ptr<BoolExpression> pc;
+  std::shared_ptr<Expressions> result;
+};
+
+// Reads the results of an RF_Binary stream one at a time. Nodes are rebuilt
+// exactly as written, without going through an ExprFactory, and are shared
+// between results just as they were when written. Throws
+// std::runtime_error on malformed input.
+class ResultReader {
+public:
+  explicit ResultReader(std::istream &in);
+
+  // Returns false at the end of the stream.
+  bool next(StoredResult &result);
+
+private:
+  uint64_t readVarint();
+  int64_t readSigned();
+  const std::string &readName();
+  std::shared_ptr<Expressions> readReference();
+  template <typename T> std::shared_ptr<T> readReference();
+  std::shared_ptr<Expressions> readNode(int code);
+
+  std::streambuf &in;
+  std::vector<std::string> names;
+  std::vector<std::shared_ptr<Expressions>> nodes;
+};
+
+// Kinds of the records of an RF_Indexed file. A node record holds what the
+// constructor of its node takes, in the same order.
+enum StoredNodeKind : uint32_t {
+  SN_Name = 1,
+  SN_BoolConst,
+  SN_BoolSymbol,
+  SN_BoolNeg,
+  SN_BoolAnd,
+  SN_BoolOr,
+  SN_BoolIte,
+  SN_IntLess,
+  SN_IntGreater,
+  SN_IntConst,
+  SN_IntSymbol,
+  SN_IntAdd,
+  SN_IntSub,
+  SN_LinearExpr,
+  SN_IntIte,
+};
+
+class ResultFile;
+
+// A node of a ResultFile, read in place from the mapped file. Cheap to copy;
+// valid as long as the file is.
+class StoredNode {
+public:
+  StoredNodeKind kind() const { return static_cast<StoredNodeKind>(type); }
+
+  // the operands of negations, conjunctions, disjunctions, comparisons,
+  // additions, subtractions and ites
+  size_t operandCount() const;
+  StoredNode operand(size_t index) const;
+  // the value of a constant
+  int64_t value() const;
+  // symbols
+  std::string_view identifier() const;
+  uint32_t symbolId() const;
+  // linear expressions
+  size_t termCount() const;
+  StoredNode termSymbol(size_t index) const;
+  int64_t termCoefficient(size_t index) const;
+  int64_t constant() const;
+
+  // Identifies the node within its file.
+  uint64_t offset() const { return position; }
+
+private:
+  friend class ResultFile;
+
+  StoredNode(const ResultFile &file, uint64_t position);
+
+  uint64_t word(size_t index) const;
+  StoredNode reference(size_t index) const;
+
+  const ResultFile *file;
+  uint64_t position;
+  uint32_t type;
+  uint32_t words;
+};
+
+// An RF_Indexed file mapped into memory. Nothing is read up front: paths are
+// found by their position in the index and their expressions are read in
+// place, so looking up one path costs the same whatever the size of the
+// file. Throws std::runtime_error on malformed input.
+class ResultFile {
+public:
+  explicit ResultFile(const std::string &path);
+  ~ResultFile();
+  ResultFile(const ResultFile &) = delete;
+  ResultFile &operator=(const ResultFile &) = delete;
+
+  // the number of paths
+  size_t size() const { return paths; }
+  size_t parameterCount() const { return parameters; }
+  std::string_view parameterName(size_t index) const;
+
+  StoredNode pc(size_t path) const;
+  StoredNode result(size_t path) const;
+  StoredNode value(size_t path, size_t parameter) const;
+
+  // Rebuilds the expression of a node, as ResultReader does. Nodes loaded
+  // before are reused, so repeated loads are cheap. Not thread-safe.
+  std::shared_ptr<Expressions> load(StoredNode node);
+  StoredResult load(size_t path);
+
+private:
+  friend class StoredNode;
+
+  void unmap();
+  uint64_t word(uint64_t offset) const;
+  uint64_t entry(size_t path, size_t field) const;
+  std::string_view name(uint64_t offset) const;
+  std::shared_ptr<Expressions> build(StoredNode node);
+
+  const char *data = nullptr;
+  size_t length = 0;
+  // whether data is mapped, rather than read into contents
+  bool mapped = false;
+  std::string contents;
+  // end of the records, start of the parameter names
+  uint64_t recordsEnd = 0;
+  uint64_t indexOffset = 0;
+  size_t parameters = 0;
+  size_t paths = 0;
+  std::unordered_map<uint64_t, std::shared_ptr<Expressions>> loaded;
+};
+
+} // namespace mysym
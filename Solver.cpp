@@ -0,0 +1,1232 @@
+#include "Solver.h"
+#include "Interpreter.h"
+#include "QueryCache.h"
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <set>
+#include <shared_mutex>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_set>
+
+using namespace mysym;
+
+std::string mysym::toString(SatResult result) {
+  switch (result) {
+  case SatResult::Sat:
+    return "sat";
+  case SatResult::Unsat:
+    return "unsat";
+  case SatResult::Unknown:
+    return "unknown";
+  }
+  return "unknown";
+}
+
+namespace {
+
+// Wide enough that lowering int64 expressions never overflows; eliminations
+// use checked arithmetic and give up with Unknown instead of wrapping.
+using Int = __int128;
+
+constexpr size_t maxConstraints = 4096;
+// Nodes of the case split one search visits before giving up with Unknown,
+// which keeps the path.
+constexpr size_t maxSearchSteps = 4096;
+// A value that may wrap in more ways than this is replaced by a fresh
+// variable, which only loses precision.
+constexpr size_t maxWrapCases = 16;
+
+// Symbols and every value the interpreter computes are int64, wrapping on
+// overflow. The solver works over the integers: a sum s stands for
+// s - k * 2^64 for the k that brings it into range.
+const Int int64Min = std::numeric_limits<int64_t>::min();
+const Int int64Max = std::numeric_limits<int64_t>::max();
+const Int wrapModulus = Int(1) << 64;
+
+// value reduced modulo 2^64 into int64, as the interpreter computes it
+Int wrap(Int value) {
+  return static_cast<int64_t>(static_cast<uint64_t>(value));
+}
+
+bool checkedMul(Int lhs, Int rhs, Int &result) {
+  return !__builtin_mul_overflow(lhs, rhs, &result);
+}
+
+bool checkedAdd(Int lhs, Int rhs, Int &result) {
+  return !__builtin_add_overflow(lhs, rhs, &result);
+}
+
+Int absInt(Int value) { return value < 0 ? -value : value; }
+
+Int gcdInt(Int lhs, Int rhs) {
+  lhs = absInt(lhs);
+  rhs = absInt(rhs);
+  while (rhs != 0) {
+    Int rest = lhs % rhs;
+    lhs = rhs;
+    rhs = rest;
+  }
+  return lhs;
+}
+
+// Both assume a positive divisor.
+Int floorDiv(Int value, Int divisor) {
+  Int quotient = value / divisor;
+  if (value % divisor != 0 && value < 0)
+    --quotient;
+  return quotient;
+}
+
+Int ceilDiv(Int value, Int divisor) {
+  Int quotient = value / divisor;
+  if (value % divisor != 0 && value > 0)
+    ++quotient;
+  return quotient;
+}
+
+bool fitsInt64(Int value) {
+  return value >= std::numeric_limits<int64_t>::min() &&
+         value <= std::numeric_limits<int64_t>::max();
+}
+
+// sum(coefficient * variable) + constant <= 0, coefficients sorted by
+// variable and non-zero.
+struct Constraint {
+  std::vector<std::pair<uint32_t, Int>> coefficients;
+  Int constant = 0;
+
+  Int coefficientOf(uint32_t variable) const {
+    for (const auto &[var, coefficient] : coefficients)
+      if (var == variable)
+        return coefficient;
+    return 0;
+  }
+
+  // Divides by the gcd of the coefficients and rounds the constant up,
+  // which is exact for integer solutions.
+  void normalize() {
+    Int divisor = 0;
+    for (const auto &[_, coefficient] : coefficients)
+      divisor = gcdInt(divisor, coefficient);
+    if (divisor <= 1)
+      return;
+    for (auto &[_, coefficient] : coefficients)
+      coefficient /= divisor;
+    constant = ceilDiv(constant, divisor);
+  }
+};
+
+struct Formula {
+  enum Kind {
+    F_True,
+    F_False,
+    F_And,
+    F_Or,
+    F_Bool,
+    F_Int,
+  };
+
+  explicit Formula(Kind kind) : kind(kind) {}
+
+  Kind kind;
+  std::vector<const Formula *> children;
+  uint32_t variable = 0;
+  bool polarity = true;
+  Constraint constraint;
+};
+
+struct LinearSum {
+  std::map<uint32_t, Int> coefficients;
+  Int constant = 0;
+};
+
+// The values of sum with every variable in the int64 range, or nullopt if
+// they do not fit Int.
+std::optional<std::pair<Int, Int>> rangeOf(const LinearSum &sum) {
+  Int low = sum.constant;
+  Int high = sum.constant;
+  for (const auto &[variable, coefficient] : sum.coefficients) {
+    Int atMin, atMax;
+    if (!checkedMul(coefficient, int64Min, atMin) ||
+        !checkedMul(coefficient, int64Max, atMax) ||
+        !checkedAdd(low, std::min(atMin, atMax), low) ||
+        !checkedAdd(high, std::max(atMin, atMax), high))
+      return std::nullopt;
+  }
+  return std::make_pair(low, high);
+}
+
+// Owns the negation normal form of a query and its variable numbering.
+// Contexts extended concurrently share one Query: translations already made
+// are found under a shared lock, new ones are made under an exclusive one,
+// and formulas never change once made.
+class Query {
+public:
+  const Formula *translate(const std::shared_ptr<BoolExpression> &expr,
+                           bool polarity);
+  // The same for subterms, with the exclusive lock already held.
+  const Formula *translateLocked(const std::shared_ptr<BoolExpression> &expr,
+                                 bool polarity);
+
+  uint32_t intVariable(const std::string &name) {
+    return variable(name, intVariables, intNames);
+  }
+  uint32_t boolVariable(const std::string &name) {
+    return variable(name, boolVariables, boolNames);
+  }
+
+  const Formula *constant(bool value) {
+    return make(Formula(value ? Formula::F_True : Formula::F_False));
+  }
+  const Formula *make(Formula formula) {
+    return &formulas.emplace_back(std::move(formula));
+  }
+
+  // lhs - rhs + offset <= 0, both sides wrapped into int64
+  const Formula *difference(const IntExpression &lhs, const IntExpression &rhs,
+                            Int offset);
+  // sum <= 0
+  const Formula *atMost(const LinearSum &sum);
+
+  // One way for a sum to wrap into int64: the conditions selecting it and
+  // the sum with the wrap subtracted.
+  struct WrapCase {
+    std::vector<const Formula *> conditions;
+    LinearSum value;
+  };
+  // The ways expr wraps, a single unconditional case if it cannot overflow.
+  // Too many cases give a fresh variable instead, unrelated to expr.
+  std::vector<WrapCase> wrapped(const IntExpression &expr,
+                                std::vector<const Formula *> &definitions);
+  // wrapCase.conditions & atMost(wrapCase.value - sum)
+  const Formula *compare(const WrapCase &wrapCase, const LinearSum &sum);
+  // The fresh variable v naming an integer ite; its definition
+  // (c & v = then) | (!c & v = else) is added to definitions.
+  uint32_t iteVariable(const IntIte &expr,
+                       std::vector<const Formula *> &definitions);
+
+  size_t intCount() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return intNames.size();
+  }
+  std::pair<std::vector<std::string>, std::vector<std::string>> names() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return {intNames, boolNames};
+  }
+
+private:
+  static uint32_t variable(const std::string &name,
+                           std::unordered_map<std::string, uint32_t> &ids,
+                           std::vector<std::string> &names) {
+    auto [it, New] = ids.emplace(name, static_cast<uint32_t>(names.size()));
+    if (New)
+      names.push_back(name);
+    return it->second;
+  }
+
+  std::deque<Formula> formulas;
+  // the expression is retained so its address cannot be reused while the
+  // query outlives it
+  std::map<std::pair<const Expressions *, bool>,
+           std::pair<std::shared_ptr<const Expressions>, const Formula *>>
+      memo;
+  std::unordered_map<const IntIte *, std::pair<uint32_t, const Formula *>>
+      ites;
+  std::unordered_map<std::string, uint32_t> intVariables;
+  std::unordered_map<std::string, uint32_t> boolVariables;
+  std::vector<std::string> intNames;
+  std::vector<std::string> boolNames;
+  size_t freshCount = 0;
+  mutable std::shared_mutex mutex;
+};
+
+// Integer ites in the expression become variables whose definitions are
+// collected in definitions.
+class LinearLowering : public IExpressionsVisitor {
+public:
+  LinearLowering(Query &query, LinearSum &sum,
+                 std::vector<const Formula *> &definitions)
+      : query(query), sum(sum), definitions(definitions) {}
+
+  void lower(const IntExpression &expr, Int scale) {
+    Int saved = this->scale;
+    this->scale = scale;
+    expr.accept(*this);
+    this->scale = saved;
+  }
+
+  void visitIntConst(const IntConst &expr) override {
+    sum.constant += scale * expr.value;
+  }
+  void visitIntSymbol(const IntSymbol &expr) override {
+    sum.coefficients[query.intVariable(expr.identifier)] += scale;
+  }
+  void visitIntAdd(const IntAdd &expr) override {
+    lower(*expr.lhs, scale);
+    lower(*expr.rhs, scale);
+  }
+  void visitIntSub(const IntSub &expr) override {
+    lower(*expr.lhs, scale);
+    lower(*expr.rhs, -scale);
+  }
+  void visitLinearExpr(const LinearExpr &expr) override {
+    for (const LinearExpr::Term &term : expr.terms)
+      sum.coefficients[query.intVariable(term.symbol->identifier)] +=
+          scale * term.coefficient;
+    sum.constant += scale * expr.constant;
+  }
+  void visitIntIte(const IntIte &expr) override {
+    sum.coefficients[query.iteVariable(expr, definitions)] += scale;
+  }
+
+private:
+  Query &query;
+  LinearSum &sum;
+  std::vector<const Formula *> &definitions;
+  Int scale = 1;
+};
+
+// formula & definitions
+Formula withDefinitions(const Formula *formula,
+                        const std::vector<const Formula *> &definitions) {
+  Formula result(Formula::F_And);
+  result.children.push_back(formula);
+  result.children.insert(result.children.end(), definitions.begin(),
+                         definitions.end());
+  return result;
+}
+
+std::vector<Query::WrapCase>
+Query::wrapped(const IntExpression &expr,
+               std::vector<const Formula *> &definitions) {
+  LinearSum sum;
+  LinearLowering(*this, sum, definitions).lower(expr, 1);
+  std::vector<WrapCase> cases;
+  // k such that sum - k * 2^64 is in range, for the lowest and highest sum
+  auto range = rangeOf(sum);
+  Int first, last;
+  if (range && checkedAdd(range->first, -int64Min, first) &&
+      checkedAdd(range->second, -int64Min, last)) {
+    first = floorDiv(first, wrapModulus);
+    last = floorDiv(last, wrapModulus);
+    if (last - first < Int(maxWrapCases)) {
+      for (Int wraps = first; wraps <= last; ++wraps) {
+        WrapCase &wrapCase = cases.emplace_back();
+        wrapCase.value = sum;
+        wrapCase.value.constant -= wraps * wrapModulus;
+        // value <= int64Max and int64Min <= value, where they can fail
+        if (range->second - wraps * wrapModulus > int64Max) {
+          LinearSum above = wrapCase.value;
+          above.constant -= int64Max;
+          wrapCase.conditions.push_back(atMost(above));
+        }
+        if (range->first - wraps * wrapModulus < int64Min) {
+          LinearSum below;
+          for (const auto &[variable, coefficient] : sum.coefficients)
+            below.coefficients[variable] = -coefficient;
+          below.constant = int64Min - wrapCase.value.constant;
+          wrapCase.conditions.push_back(atMost(below));
+        }
+      }
+      return cases;
+    }
+  }
+  // '#' cannot occur in identifiers of the language
+  WrapCase &fresh = cases.emplace_back();
+  fresh.value.coefficients[intVariable("#wrap" +
+                                       std::to_string(freshCount++))] = 1;
+  return cases;
+}
+
+const Formula *Query::compare(const WrapCase &wrapCase, const LinearSum &sum) {
+  LinearSum difference = wrapCase.value;
+  for (const auto &[variable, coefficient] : sum.coefficients)
+    difference.coefficients[variable] -= coefficient;
+  difference.constant -= sum.constant;
+  const Formula *formula = atMost(difference);
+  if (wrapCase.conditions.empty())
+    return formula;
+  return make(withDefinitions(formula, wrapCase.conditions));
+}
+
+const Formula *Query::difference(const IntExpression &lhs,
+                                 const IntExpression &rhs, Int offset) {
+  std::vector<const Formula *> definitions;
+  std::vector<WrapCase> left = wrapped(lhs, definitions);
+  std::vector<WrapCase> right = wrapped(rhs, definitions);
+  Formula cases(Formula::F_Or);
+  for (const WrapCase &rightCase : right) {
+    // lhs - rhs + offset <= 0 as lhs - (rhs - offset) <= 0
+    LinearSum bound = rightCase.value;
+    bound.constant -= offset;
+    for (const WrapCase &leftCase : left) {
+      const Formula *formula = compare(leftCase, bound);
+      if (!rightCase.conditions.empty())
+        formula = make(withDefinitions(formula, rightCase.conditions));
+      cases.children.push_back(formula);
+    }
+  }
+  const Formula *formula = cases.children.size() == 1
+                               ? cases.children.front()
+                               : make(std::move(cases));
+  if (definitions.empty())
+    return formula;
+  return make(withDefinitions(formula, definitions));
+}
+
+const Formula *Query::atMost(const LinearSum &sum) {
+  Formula formula(Formula::F_Int);
+  for (const auto &[variable, coefficient] : sum.coefficients)
+    if (coefficient != 0)
+      formula.constraint.coefficients.emplace_back(variable, coefficient);
+  formula.constraint.constant = sum.constant;
+  if (formula.constraint.coefficients.empty())
+    return constant(formula.constraint.constant <= 0);
+  return make(std::move(formula));
+}
+
+uint32_t Query::iteVariable(const IntIte &expr,
+                            std::vector<const Formula *> &definitions) {
+  auto it = ites.find(&expr);
+  if (it == ites.end()) {
+    // '#' cannot occur in identifiers of the language
+    uint32_t variable = intVariable("#ite" + std::to_string(ites.size()));
+    // ites nested in the branches are defined along with this one, so the
+    // definition is complete wherever it is reused
+    std::vector<const Formula *> nested;
+    // the variable equals value wrapped into int64
+    auto equals = [&](const IntExpression &value) {
+      LinearSum self;
+      self.coefficients[variable] = 1;
+      Formula cases(Formula::F_Or);
+      for (const WrapCase &wrapCase : wrapped(value, nested)) {
+        Formula both(Formula::F_And);
+        both.children = {compare(wrapCase, self),
+                         compare(WrapCase{{}, self}, wrapCase.value)};
+        cases.children.push_back(make(std::move(both)));
+      }
+      if (cases.children.size() == 1)
+        return cases.children.front();
+      return make(std::move(cases));
+    };
+    Formula taken(Formula::F_And);
+    taken.children = {translateLocked(expr.condition, true),
+                      equals(*expr.thenExpr)};
+    Formula skipped(Formula::F_And);
+    skipped.children = {translateLocked(expr.condition, false),
+                        equals(*expr.elseExpr)};
+    Formula choice(Formula::F_Or);
+    choice.children = {make(std::move(taken)), make(std::move(skipped))};
+    const Formula *definition =
+        make(withDefinitions(make(std::move(choice)), nested));
+    it = ites.emplace(&expr, std::make_pair(variable, definition)).first;
+  }
+  definitions.push_back(it->second.second);
+  return it->second.first;
+}
+
+class FormulaBuilder : public IExpressionsVisitor {
+public:
+  FormulaBuilder(Query &query, bool polarity)
+      : query(query), polarity(polarity) {}
+
+  const Formula *result = nullptr;
+
+  void visitBoolConst(const BoolConst &expr) override {
+    result = query.constant(expr.value == polarity);
+  }
+  void visitBoolSymbol(const BoolSymbol &expr) override {
+    Formula formula(Formula::F_Bool);
+    formula.variable = query.boolVariable(expr.identifier);
+    formula.polarity = polarity;
+    result = query.make(std::move(formula));
+  }
+  void visitBoolNeg(const BoolNeg &expr) override {
+    result = query.translateLocked(expr.subExpr, !polarity);
+  }
+  void visitBoolAnd(const BoolAnd &expr) override {
+    junction(polarity ? Formula::F_And : Formula::F_Or, expr.lhs, expr.rhs);
+  }
+  void visitBoolOr(const BoolOr &expr) override {
+    junction(polarity ? Formula::F_Or : Formula::F_And, expr.lhs, expr.rhs);
+  }
+  // (c & t) | (!c & e); negating the ite negates both branches
+  void visitBoolIte(const BoolIte &expr) override {
+    Formula taken(Formula::F_And);
+    taken.children = {query.translateLocked(expr.condition, true),
+                      query.translateLocked(expr.thenExpr, polarity)};
+    Formula skipped(Formula::F_And);
+    skipped.children = {query.translateLocked(expr.condition, false),
+                        query.translateLocked(expr.elseExpr, polarity)};
+    Formula formula(Formula::F_Or);
+    formula.children = {query.make(std::move(taken)),
+                        query.make(std::move(skipped))};
+    result = query.make(std::move(formula));
+  }
+  // over integers a < b is a - b + 1 <= 0 and !(a < b) is b - a <= 0
+  void visitIntLess(const IntLess &expr) override {
+    result = polarity ? query.difference(*expr.lhs, *expr.rhs, 1)
+                      : query.difference(*expr.rhs, *expr.lhs, 0);
+  }
+  void visitIntGreater(const IntGreater &expr) override {
+    result = polarity ? query.difference(*expr.rhs, *expr.lhs, 1)
+                      : query.difference(*expr.lhs, *expr.rhs, 0);
+  }
+
+private:
+  void junction(Formula::Kind kind, const std::shared_ptr<BoolExpression> &lhs,
+                const std::shared_ptr<BoolExpression> &rhs) {
+    const Formula *left = query.translateLocked(lhs, polarity);
+    const Formula *right = query.translateLocked(rhs, polarity);
+    Formula formula(kind);
+    formula.children = {left, right};
+    result = query.make(std::move(formula));
+  }
+
+  Query &query;
+  bool polarity;
+};
+
+const Formula *Query::translate(const std::shared_ptr<BoolExpression> &expr,
+                                bool polarity) {
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = memo.find(std::make_pair(expr.get(), polarity));
+    if (it != memo.end())
+      return it->second.second;
+  }
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  return translateLocked(expr, polarity);
+}
+
+const Formula *
+Query::translateLocked(const std::shared_ptr<BoolExpression> &expr,
+                       bool polarity) {
+  auto key = std::make_pair(static_cast<const Expressions *>(expr.get()),
+                            polarity);
+  auto it = memo.find(key);
+  if (it != memo.end())
+    return it->second.second;
+  FormulaBuilder builder(*this, polarity);
+  expr->accept(builder);
+  if (!builder.result)
+    throw std::runtime_error("solver: unsupported expression " +
+                             render(*expr));
+  memo.emplace(key, std::make_pair(expr, builder.result));
+  return builder.result;
+}
+
+// Fourier-Motzkin elimination over the integers. Every derived constraint is
+// tightened by its gcd, so an unsatisfiable result is exact; a model is then
+// built by back-substitution and the check gives up if an integer gap is hit.
+SatResult solveTheory(std::vector<Constraint> constraints, size_t variableCount,
+                      std::vector<Int> *values) {
+  // every variable holds an int64
+  std::set<uint32_t> variables;
+  for (const Constraint &constraint : constraints)
+    for (const auto &[variable, _] : constraint.coefficients)
+      variables.insert(variable);
+  for (uint32_t variable : variables) {
+    constraints.push_back(Constraint{{{variable, 1}}, -int64Max});
+    constraints.push_back(Constraint{{{variable, -1}}, int64Min});
+  }
+
+  struct Elimination {
+    uint32_t variable;
+    std::vector<Constraint> bounds;
+  };
+  std::vector<Elimination> eliminations;
+
+  while (true) {
+    std::vector<Constraint> open;
+    open.reserve(constraints.size());
+    for (Constraint &constraint : constraints) {
+      if (constraint.coefficients.empty()) {
+        if (constraint.constant > 0)
+          return SatResult::Unsat;
+        continue;
+      }
+      constraint.normalize();
+      open.push_back(std::move(constraint));
+    }
+    // among constraints with equal coefficients only the tightest matters
+    std::sort(open.begin(), open.end(),
+              [](const Constraint &lhs, const Constraint &rhs) {
+                if (lhs.coefficients != rhs.coefficients)
+                  return lhs.coefficients < rhs.coefficients;
+                return lhs.constant > rhs.constant;
+              });
+    open.erase(std::unique(open.begin(), open.end(),
+                           [](const Constraint &lhs, const Constraint &rhs) {
+                             return lhs.coefficients == rhs.coefficients;
+                           }),
+               open.end());
+    if (open.empty())
+      break;
+
+    std::map<uint32_t, std::pair<size_t, size_t>> occurrences;
+    for (const Constraint &constraint : open)
+      for (const auto &[variable, coefficient] : constraint.coefficients)
+        ++(coefficient > 0 ? occurrences[variable].second
+                           : occurrences[variable].first);
+    uint32_t variable = occurrences.begin()->first;
+    size_t bestCost = std::numeric_limits<size_t>::max();
+    for (const auto &[candidate, counts] : occurrences) {
+      size_t cost = counts.first * counts.second;
+      if (cost < bestCost) {
+        bestCost = cost;
+        variable = candidate;
+      }
+    }
+
+    Elimination elimination{variable, {}};
+    std::vector<Constraint> next;
+    std::vector<const Constraint *> lower, upper;
+    for (const Constraint &constraint : open) {
+      Int coefficient = constraint.coefficientOf(variable);
+      if (coefficient == 0)
+        next.push_back(constraint);
+      else
+        elimination.bounds.push_back(constraint);
+    }
+    for (const Constraint &bound : elimination.bounds)
+      (bound.coefficientOf(variable) > 0 ? upper : lower).push_back(&bound);
+    for (const Constraint *up : upper) {
+      Int upCoefficient = up->coefficientOf(variable);
+      for (const Constraint *low : lower) {
+        Int lowCoefficient = -low->coefficientOf(variable);
+        // lowCoefficient * up + upCoefficient * low cancels the variable
+        std::map<uint32_t, Int> combined;
+        Int constant, lhs, rhs;
+        if (!checkedMul(up->constant, lowCoefficient, lhs) ||
+            !checkedMul(low->constant, upCoefficient, rhs) ||
+            !checkedAdd(lhs, rhs, constant))
+          return SatResult::Unknown;
+        for (const auto &[var, coefficient] : up->coefficients) {
+          if (!checkedMul(coefficient, lowCoefficient, lhs))
+            return SatResult::Unknown;
+          combined[var] = lhs;
+        }
+        for (const auto &[var, coefficient] : low->coefficients) {
+          if (!checkedMul(coefficient, upCoefficient, rhs) ||
+              !checkedAdd(combined[var], rhs, combined[var]))
+            return SatResult::Unknown;
+        }
+        Constraint constraint;
+        constraint.constant = constant;
+        for (const auto &[var, coefficient] : combined)
+          if (coefficient != 0)
+            constraint.coefficients.emplace_back(var, coefficient);
+        next.push_back(std::move(constraint));
+      }
+    }
+    if (next.size() > maxConstraints)
+      return SatResult::Unknown;
+    eliminations.push_back(std::move(elimination));
+    constraints = std::move(next);
+  }
+
+  if (!values)
+    return SatResult::Sat;
+  values->assign(variableCount, 0);
+  for (auto it = eliminations.rbegin(); it != eliminations.rend(); ++it) {
+    std::optional<Int> lowerBound, upperBound;
+    for (const Constraint &bound : it->bounds) {
+      Int rest = bound.constant;
+      Int coefficient = 0;
+      for (const auto &[var, varCoefficient] : bound.coefficients) {
+        if (var == it->variable) {
+          coefficient = varCoefficient;
+          continue;
+        }
+        Int term;
+        if (!checkedMul(varCoefficient, (*values)[var], term) ||
+            !checkedAdd(rest, term, rest))
+          return SatResult::Unknown;
+      }
+      if (coefficient > 0) {
+        Int bound = floorDiv(-rest, coefficient);
+        upperBound = upperBound ? std::min(*upperBound, bound) : bound;
+      } else {
+        Int bound = ceilDiv(rest, -coefficient);
+        lowerBound = lowerBound ? std::max(*lowerBound, bound) : bound;
+      }
+    }
+    if (lowerBound && upperBound && *lowerBound > *upperBound)
+      return SatResult::Unknown;
+    Int value = 0;
+    if (lowerBound && value < *lowerBound)
+      value = *lowerBound;
+    if (upperBound && value > *upperBound)
+      value = *upperBound;
+    (*values)[it->variable] = value;
+  }
+  return SatResult::Sat;
+}
+
+// What the conjuncts processed so far fix directly: boolean literals, linear
+// constraints, and the disjunctions still to be split on.
+struct Facts {
+  std::vector<int8_t> bools;
+  std::vector<Constraint> constraints;
+  std::vector<const Formula *> disjunctions;
+
+  // Returns false on a propositional conflict.
+  bool add(const Formula *root) {
+    std::vector<const Formula *> pending{root};
+    while (!pending.empty()) {
+      const Formula *formula = pending.back();
+      pending.pop_back();
+      switch (formula->kind) {
+      case Formula::F_True:
+        break;
+      case Formula::F_False:
+        return false;
+      case Formula::F_And:
+        pending.insert(pending.end(), formula->children.begin(),
+                       formula->children.end());
+        break;
+      case Formula::F_Or:
+        disjunctions.push_back(formula);
+        break;
+      case Formula::F_Bool: {
+        if (formula->variable >= bools.size())
+          bools.resize(formula->variable + 1, 0);
+        int8_t value = formula->polarity ? 1 : -1;
+        int8_t &assigned = bools[formula->variable];
+        if (assigned == -value)
+          return false;
+        assigned = value;
+        break;
+      }
+      case Formula::F_Int:
+        constraints.push_back(formula->constraint);
+        break;
+      }
+    }
+    return true;
+  }
+};
+
+// Case splitting over the disjunctions, checking the theory part of every
+// partial assignment before splitting further. Nested ites of merged paths
+// multiply the cases, so a search gives up after maxSearchSteps of them.
+class Search {
+public:
+  explicit Search(const Query &query)
+      : query(query), intCount(query.intCount()) {}
+
+  SatResult run(Facts facts) {
+    if (++steps > maxSearchSteps)
+      return SatResult::Unknown;
+    if (facts.disjunctions.empty()) {
+      std::vector<Int> values;
+      SatResult result =
+          solveTheory(std::move(facts.constraints), intCount, &values);
+      if (result == SatResult::Sat) {
+        boolValues = std::move(facts.bools);
+        intValues = std::move(values);
+      }
+      return result;
+    }
+
+    if (solveTheory(facts.constraints, intCount, nullptr) == SatResult::Unsat)
+      return SatResult::Unsat;
+    const Formula *split = facts.disjunctions.back();
+    facts.disjunctions.pop_back();
+    SatResult result = SatResult::Unsat;
+    for (const Formula *child : split->children) {
+      Facts branch = facts;
+      if (!branch.add(child))
+        continue;
+      SatResult outcome = run(std::move(branch));
+      if (outcome == SatResult::Sat)
+        return outcome;
+      if (outcome == SatResult::Unknown)
+        result = SatResult::Unknown;
+    }
+    return result;
+  }
+
+  // Converts the values found by a successful run; Unknown if an integer
+  // does not fit the int64 range of the symbols.
+  SatResult takeModel(Model &model) const {
+    auto [intNames, boolNames] = query.names();
+    for (size_t index = 0; index < intNames.size(); ++index) {
+      Int value = index < intValues.size() ? intValues[index] : 0;
+      if (!fitsInt64(value))
+        return SatResult::Unknown;
+      model.ints.emplace(intNames[index], static_cast<int64_t>(value));
+    }
+    for (size_t index = 0; index < boolNames.size(); ++index)
+      model.bools.emplace(boolNames[index],
+                          index < boolValues.size() && boolValues[index] > 0);
+    return SatResult::Sat;
+  }
+
+private:
+  const Query &query;
+  // variables translated before the search started
+  size_t intCount;
+  size_t steps = 0;
+  std::vector<int8_t> boolValues;
+  std::vector<Int> intValues;
+};
+
+class ModelEvaluator : public IExpressionsVisitor {
+public:
+  explicit ModelEvaluator(const Model &model) : model(model) {}
+
+  bool evaluate(const BoolExpression &expr) {
+    expr.accept(*this);
+    return boolValue;
+  }
+
+  void visitBoolConst(const BoolConst &expr) override {
+    boolValue = expr.value;
+  }
+  void visitBoolSymbol(const BoolSymbol &expr) override {
+    auto it = model.bools.find(expr.identifier);
+    boolValue = it != model.bools.end() && it->second;
+  }
+  void visitBoolNeg(const BoolNeg &expr) override {
+    expr.subExpr->accept(*this);
+    boolValue = !boolValue;
+  }
+  void visitBoolAnd(const BoolAnd &expr) override {
+    expr.lhs->accept(*this);
+    bool lhs = boolValue;
+    expr.rhs->accept(*this);
+    boolValue = lhs && boolValue;
+  }
+  void visitBoolOr(const BoolOr &expr) override {
+    expr.lhs->accept(*this);
+    bool lhs = boolValue;
+    expr.rhs->accept(*this);
+    boolValue = lhs || boolValue;
+  }
+  void visitBoolIte(const BoolIte &expr) override {
+    expr.condition->accept(*this);
+    (boolValue ? expr.thenExpr : expr.elseExpr)->accept(*this);
+  }
+  void visitIntLess(const IntLess &expr) override {
+    Int lhs = evaluate(*expr.lhs);
+    boolValue = lhs < evaluate(*expr.rhs);
+  }
+  void visitIntGreater(const IntGreater &expr) override {
+    Int lhs = evaluate(*expr.lhs);
+    boolValue = lhs > evaluate(*expr.rhs);
+  }
+  void visitIntConst(const IntConst &expr) override { intValue = expr.value; }
+  void visitIntSymbol(const IntSymbol &expr) override {
+    auto it = model.ints.find(expr.identifier);
+    intValue = it != model.ints.end() ? it->second : 0;
+  }
+  void visitIntAdd(const IntAdd &expr) override {
+    Int lhs = evaluate(*expr.lhs);
+    intValue = wrap(lhs + evaluate(*expr.rhs));
+  }
+  void visitIntSub(const IntSub &expr) override {
+    Int lhs = evaluate(*expr.lhs);
+    intValue = wrap(lhs - evaluate(*expr.rhs));
+  }
+  void visitLinearExpr(const LinearExpr &expr) override {
+    Int sum = expr.constant;
+    for (const LinearExpr::Term &term : expr.terms)
+      sum = wrap(sum + evaluate(*term.symbol) * term.coefficient);
+    intValue = sum;
+  }
+  void visitIntIte(const IntIte &expr) override {
+    expr.condition->accept(*this);
+    intValue = evaluate(boolValue ? *expr.thenExpr : *expr.elseExpr);
+  }
+
+private:
+  Int evaluate(const IntExpression &expr) {
+    expr.accept(*this);
+    return intValue;
+  }
+
+  const Model &model;
+  bool boolValue = false;
+  // always in the int64 range
+  Int intValue = 0;
+};
+
+class SymbolCollector : public IExpressionsVisitor {
+public:
+  std::vector<std::string> ints;
+  std::vector<std::string> bools;
+
+  void collect(const Expressions &expr) {
+    if (visited.insert(&expr).second)
+      expr.accept(*this);
+  }
+
+  void visitBoolSymbol(const BoolSymbol &expr) override {
+    bools.push_back(expr.identifier);
+  }
+  void visitBoolNeg(const BoolNeg &expr) override { collect(*expr.subExpr); }
+  void visitBoolAnd(const BoolAnd &expr) override { both(expr); }
+  void visitBoolOr(const BoolOr &expr) override { both(expr); }
+  void visitBoolIte(const BoolIte &expr) override { all(expr); }
+  void visitIntLess(const IntLess &expr) override { both(expr); }
+  void visitIntGreater(const IntGreater &expr) override { both(expr); }
+  void visitIntSymbol(const IntSymbol &expr) override {
+    ints.push_back(expr.identifier);
+  }
+  void visitIntAdd(const IntAdd &expr) override { both(expr); }
+  void visitIntSub(const IntSub &expr) override { both(expr); }
+  void visitLinearExpr(const LinearExpr &expr) override {
+    for (const LinearExpr::Term &term : expr.terms)
+      collect(*term.symbol);
+  }
+  void visitIntIte(const IntIte &expr) override { all(expr); }
+
+private:
+  template <typename Binary> void both(const Binary &expr) {
+    collect(*expr.lhs);
+    collect(*expr.rhs);
+  }
+  template <typename Ite> void all(const Ite &expr) {
+    collect(*expr.condition);
+    collect(*expr.thenExpr);
+    collect(*expr.elseExpr);
+  }
+
+  std::unordered_set<const Expressions *> visited;
+};
+
+struct IndependentGroup {
+  std::vector<std::shared_ptr<BoolExpression>> conjuncts;
+  std::vector<std::string> ints;
+  std::vector<std::string> bools;
+};
+
+// Union-find over the conjuncts, joining two whenever they mention a common
+// symbol. Groups and the conjuncts inside them keep the input order.
+std::vector<IndependentGroup>
+partition(const std::vector<std::shared_ptr<BoolExpression>> &conjuncts) {
+  std::vector<size_t> parent(conjuncts.size());
+  std::iota(parent.begin(), parent.end(), 0);
+  auto find = [&](size_t index) {
+    while (parent[index] != index)
+      index = parent[index] = parent[parent[index]];
+    return index;
+  };
+
+  std::unordered_map<std::string, size_t> intOwners, boolOwners;
+  auto join = [&](std::unordered_map<std::string, size_t> &owners,
+                  const std::string &name, size_t index) {
+    auto [it, New] = owners.emplace(name, index);
+    if (!New)
+      parent[find(index)] = find(it->second);
+  };
+  for (size_t index = 0; index < conjuncts.size(); ++index) {
+    SymbolCollector symbols;
+    symbols.collect(*conjuncts[index]);
+    for (const std::string &name : symbols.ints)
+      join(intOwners, name, index);
+    for (const std::string &name : symbols.bools)
+      join(boolOwners, name, index);
+  }
+
+  std::vector<IndependentGroup> groups;
+  std::unordered_map<size_t, size_t> groupOf;
+  for (size_t index = 0; index < conjuncts.size(); ++index) {
+    auto [it, New] = groupOf.emplace(find(index), groups.size());
+    if (New)
+      groups.emplace_back();
+    groups[it->second].conjuncts.push_back(conjuncts[index]);
+  }
+  for (const auto &[name, owner] : intOwners)
+    groups[groupOf.at(find(owner))].ints.push_back(name);
+  for (const auto &[name, owner] : boolOwners)
+    groups[groupOf.at(find(owner))].bools.push_back(name);
+  return groups;
+}
+
+// The conjuncts assumed so far, kept as independent components: a component
+// is immutable and shared by every context extended from the one that last
+// touched it. assume() copies only the list of components, of which there
+// are at most as many as the program has symbols, and rebuilds the single
+// component the new conjunct joins.
+class IncrementalContext final : public SolverContext {
+public:
+  IncrementalContext(std::shared_ptr<Query> query,
+                     std::shared_ptr<QueryCache> cache)
+      : query(std::move(query)), cache(std::move(cache)),
+        found(std::make_shared<const Model>()) {}
+
+  std::shared_ptr<const SolverContext>
+  assume(std::shared_ptr<BoolExpression> conjunct) const override;
+
+  SatResult status() const override {
+    if (unsat)
+      return SatResult::Unsat;
+    return unknown ? SatResult::Unknown : SatResult::Sat;
+  }
+  const Model &model() const override { return *found; }
+
+private:
+  // A conjunct with its translation, linked to the conjuncts assumed before
+  // it in the same component.
+  struct Assumption {
+    std::shared_ptr<const Assumption> previous;
+    std::shared_ptr<BoolExpression> conjunct;
+    const Formula *formula;
+  };
+
+  struct Component {
+    // newest first
+    std::shared_ptr<const Assumption> assumptions;
+    std::unordered_set<std::string> ints;
+    std::unordered_set<std::string> bools;
+    SatResult result;
+
+    bool mentions(const SymbolCollector &symbols) const;
+  };
+
+  // Decides a component through the cache.
+  std::pair<SatResult, std::shared_ptr<const Model>>
+  solve(const Component &component) const;
+
+  template <typename Value>
+  static Value valueOf(const std::unordered_map<std::string, Value> &values,
+                       const std::string &name) {
+    auto it = values.find(name);
+    return it != values.end() ? it->second : Value();
+  }
+
+  // shared by the whole family of contexts so that symbols keep their
+  // variable numbers and translations are reused
+  std::shared_ptr<Query> query;
+  std::shared_ptr<QueryCache> cache;
+  std::vector<std::shared_ptr<const Component>> components;
+  bool unsat = false;
+  // components the search gave up on
+  size_t unknown = 0;
+  // satisfies every component whose result is Sat
+  std::shared_ptr<const Model> found;
+};
+
+bool IncrementalContext::Component::mentions(
+    const SymbolCollector &symbols) const {
+  return std::any_of(symbols.ints.begin(), symbols.ints.end(),
+                     [&](const std::string &name) {
+                       return ints.count(name) != 0;
+                     }) ||
+         std::any_of(symbols.bools.begin(), symbols.bools.end(),
+                     [&](const std::string &name) {
+                       return bools.count(name) != 0;
+                     });
+}
+
+std::shared_ptr<const SolverContext>
+IncrementalContext::assume(std::shared_ptr<BoolExpression> conjunct) const {
+  auto next = std::make_shared<IncrementalContext>(query, cache);
+  if (unsat) {
+    next->unsat = true;
+    return next;
+  }
+  SymbolCollector symbols;
+  symbols.collect(*conjunct);
+
+  // The new conjunct joins every component it shares a symbol with; the
+  // others carry over unchanged.
+  std::vector<const Component *> touched;
+  next->components.reserve(components.size() + 1);
+  for (const auto &component : components) {
+    if (component->mentions(symbols))
+      touched.push_back(component.get());
+    else
+      next->components.push_back(component);
+  }
+
+  auto joined = std::make_shared<Component>();
+  joined->result = SatResult::Sat;
+  size_t unknownTouched = 0;
+  for (const Component *component : touched) {
+    if (touched.size() == 1) {
+      joined->assumptions = component->assumptions;
+    } else {
+      for (const Assumption *assumption = component->assumptions.get();
+           assumption; assumption = assumption->previous.get())
+        joined->assumptions = std::make_shared<Assumption>(
+            Assumption{joined->assumptions, assumption->conjunct,
+                       assumption->formula});
+    }
+    joined->ints.insert(component->ints.begin(), component->ints.end());
+    joined->bools.insert(component->bools.begin(), component->bools.end());
+    if (component->result == SatResult::Unknown)
+      ++unknownTouched;
+  }
+  joined->ints.insert(symbols.ints.begin(), symbols.ints.end());
+  joined->bools.insert(symbols.bools.begin(), symbols.bools.end());
+  joined->assumptions = std::make_shared<Assumption>(Assumption{
+      std::move(joined->assumptions), conjunct,
+      query->translate(conjunct, true)});
+  next->unknown = unknown - unknownTouched;
+  next->found = found;
+
+  // The previous model satisfies every component that was Sat, so unless
+  // the new conjunct refutes it or joins a component the search gave up
+  // on, nothing needs solving.
+  if (unknownTouched != 0 || !found->satisfies(*conjunct)) {
+    auto [result, model] = solve(*joined);
+    joined->result = result;
+    if (result == SatResult::Unsat) {
+      next->unsat = true;
+      next->components.clear();
+      return next;
+    }
+    if (result == SatResult::Sat) {
+      auto patched = std::make_shared<Model>(*found);
+      for (const std::string &name : joined->ints)
+        patched->ints[name] = valueOf(model->ints, name);
+      for (const std::string &name : joined->bools)
+        patched->bools[name] = valueOf(model->bools, name);
+      next->found = std::move(patched);
+    }
+  }
+  if (joined->result == SatResult::Unknown)
+    ++next->unknown;
+  next->components.push_back(std::move(joined));
+  return next;
+}
+
+std::pair<SatResult, std::shared_ptr<const Model>>
+IncrementalContext::solve(const Component &component) const {
+  Facts facts;
+  std::vector<std::shared_ptr<BoolExpression>> conjuncts;
+  for (const Assumption *assumption = component.assumptions.get(); assumption;
+       assumption = assumption->previous.get()) {
+    if (!facts.add(assumption->formula))
+      return {SatResult::Unsat, nullptr};
+    conjuncts.push_back(assumption->conjunct);
+  }
+  QueryCache::Key key = QueryCache::makeKey(std::move(conjuncts));
+
+  std::shared_ptr<const Model> model;
+  if (cache) {
+    if (auto cached = cache->lookup(key, &model))
+      return {*cached, model};
+  }
+  Search search(*query);
+  SatResult result = search.run(std::move(facts));
+  if (result == SatResult::Sat) {
+    auto found = std::make_shared<Model>();
+    result = search.takeModel(*found);
+    model = std::move(found);
+  }
+  if (cache)
+    cache->insert(std::move(key), result, model);
+  return {result, model};
+}
+
+class SolverFeasibilityChecker : public IFeasibilityChecker {
+public:
+  explicit SolverFeasibilityChecker(std::shared_ptr<QueryCache> cache)
+      : cache(cache), root(SolverContext::create(std::move(cache))) {}
+
+  bool
+  isFeasible(const std::vector<std::shared_ptr<BoolExpression>> &pc) override {
+    for (IndependentGroup &group : partition(QueryCache::makeKey(pc))) {
+      if (check(std::move(group.conjuncts)) == SatResult::Unsat)
+        return false;
+    }
+    return true;
+  }
+
+  bool extend(std::shared_ptr<const Context> &context,
+              const PathCondition & /*pc*/,
+              std::shared_ptr<BoolExpression> condition) override {
+    const auto &current =
+        context ? static_cast<const PathContext &>(*context).solver : root;
+    auto next = current->assume(std::move(condition));
+    if (next->status() == SatResult::Unsat)
+      return false;
+    context = std::make_shared<PathContext>(std::move(next));
+    return true;
+  }
+
+private:
+  SatResult check(QueryCache::Key key) {
+    if (!cache)
+      return checkSat(key);
+    if (auto cached = cache->lookup(key))
+      return *cached;
+    auto model = std::make_shared<Model>();
+    SatResult result = checkSat(key, model.get());
+    cache->insert(std::move(key), result, std::move(model));
+    return result;
+  }
+
+  struct PathContext : Context {
+    explicit PathContext(std::shared_ptr<const SolverContext> solver)
+        : solver(std::move(solver)) {}
+    std::shared_ptr<const SolverContext> solver;
+  };
+
+  std::shared_ptr<QueryCache> cache;
+  std::shared_ptr<const SolverContext> root;
+};
+
+} // namespace
+
+bool Model::satisfies(const BoolExpression &expr) const {
+  return ModelEvaluator(*this).evaluate(expr);
+}
+
+SatResult
+mysym::checkSat(const std::vector<std::shared_ptr<BoolExpression>> &conjuncts,
+                Model *model) {
+  Query query;
+  Facts facts;
+  for (const auto &conjunct : conjuncts)
+    if (!facts.add(query.translate(conjunct, true)))
+      return SatResult::Unsat;
+  Search search(query);
+  Model found;
+  SatResult result = search.run(std::move(facts));
+  if (result == SatResult::Sat)
+    result = search.takeModel(found);
+  if (result != SatResult::Sat)
+    return result;
+  for (const auto &conjunct : conjuncts)
+    if (!found.satisfies(*conjunct))
+      return SatResult::Unknown;
+  if (model)
+    *model = std::move(found);
+  return SatResult::Sat;
+}
+
+std::vector<std::vector<std::shared_ptr<BoolExpression>>>
+mysym::independentGroups(
+    const std::vector<std::shared_ptr<BoolExpression>> &conjuncts) {
+  std::vector<std::vector<std::shared_ptr<BoolExpression>>> groups;
+  for (IndependentGroup &group : partition(conjuncts))
+    groups.push_back(std::move(group.conjuncts));
+  return groups;
+}
+
+std::shared_ptr<const SolverContext>
+SolverContext::create(std::shared_ptr<QueryCache> cache) {
+  return std::make_shared<IncrementalContext>(std::make_shared<Query>(),
+                                              std::move(cache));
+}
+
+std::shared_ptr<IFeasibilityChecker> IFeasibilityChecker::createSolver() {
+  return createSolver(std::make_shared<QueryCache>());
+}
+
+std::shared_ptr<IFeasibilityChecker>
+IFeasibilityChecker::createSolver(std::shared_ptr<QueryCache> cache) {
+  return std::make_shared<SolverFeasibilityChecker>(std::move(cache));
+}
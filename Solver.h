@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Expressions.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mysym {
+
+class QueryCache;
+
+enum class SatResult {
+  Sat,
+  Unsat,
+  // the procedure gave up (integer gap, coefficient overflow, size limit)
+  Unknown,
+};
+
+std::string toString(SatResult result);
+
+// Values of the symbols of a satisfied query, keyed by identifier. Symbols
+// missing from the model are treated as 0 and false.
+struct Model {
+  std::unordered_map<std::string, int64_t> ints;
+  std::unordered_map<std::string, bool> bools;
+
+  // Evaluates with the wrapping int64 arithmetic of the interpreter.
+  bool satisfies(const BoolExpression &expr) const;
+};
+
+// Decides a conjunction of boolean expressions over linear int64
+// arithmetic that wraps on overflow, as the interpreter computes it: a sum
+// compared or assigned to an ite is split on the ways it can wrap. Boolean
+// structure is handled by case splitting over the negation normal form, with
+// Fourier-Motzkin elimination (with integer tightening) as the theory check
+// and back-substitution to build models. Unsat answers are exact; Sat
+// answers always come with a checked model, and searches too large to
+// finish answer Unknown.
+SatResult
+checkSat(const std::vector<std::shared_ptr<BoolExpression>> &conjuncts,
+         Model *model = nullptr);
+
+// Splits conjuncts into groups that share no symbols, not even
+// transitively, so that each group can be decided on its own.
+std::vector<std::vector<std::shared_ptr<BoolExpression>>>
+independentGroups(
+    const std::vector<std::shared_ptr<BoolExpression>> &conjuncts);
+
+// Incremental form of checkSat for a conjunction that grows one conjunct at
+// a time, as a path condition does. A context is immutable and shares what
+// was derived from its conjuncts (translations grouped into independent
+// components, the last model) with every context extended from it, so each
+// assume() only translates the new conjunct and re-solves only when the
+// previous model does not already satisfy it. Even then only the component
+// the new conjunct joins is rebuilt and solved.
+class SolverContext {
+public:
+  virtual ~SolverContext() = default;
+
+  // The empty conjunction. Queries that the previous model does not decide
+  // are looked up in cache, if given, before they are solved.
+  static std::shared_ptr<const SolverContext>
+  create(std::shared_ptr<QueryCache> cache = nullptr);
+
+  virtual std::shared_ptr<const SolverContext>
+  assume(std::shared_ptr<BoolExpression> conjunct) const = 0;
+
+  virtual SatResult status() const = 0;
+  // Only meaningful when status() is Sat.
+  virtual const Model &model() const = 0;
+};
+
+} // namespace mysym
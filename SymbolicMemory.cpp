@@ -1,52 +1,144 @@
 #include "SymbolicMemory.h"
 #include "AST.h"
+#include "ExprFactory.h"
 #include "Expressions.h"
-#include "cereal/archives/json.hpp"
-#include "cereal/cereal.hpp"
+#include <array>
+#include <stdexcept>
 
 using namespace mysym;
 
-SymbolicMemory::SymbolicMemory() = default;
+namespace {
 
-SymbolicMemory::SymbolicMemory(std::shared_ptr<const Function> function)
+constexpr unsigned FanoutBits = 4;
+constexpr size_t Fanout = size_t(1) << FanoutBits;
+
+struct Leaf {
+  std::array<std::shared_ptr<Expressions>, Fanout> values;
+};
+
+struct Inner {
+  std::array<std::shared_ptr<const void>, Fanout> children;
+};
+
+size_t slotOf(size_t index, unsigned depth) {
+  return (index >> (FanoutBits * depth)) & (Fanout - 1);
+}
+
+std::shared_ptr<const void>
+build(const std::vector<std::shared_ptr<Expressions>> &values, size_t begin,
+      unsigned depth) {
+  if (depth == 0) {
+    auto leaf = std::make_shared<Leaf>();
+    for (size_t slot = 0; slot < Fanout && begin + slot < values.size();
+         ++slot)
+      leaf->values[slot] = values[begin + slot];
+    return leaf;
+  }
+  auto inner = std::make_shared<Inner>();
+  size_t span = size_t(1) << (FanoutBits * depth);
+  for (size_t slot = 0; slot < Fanout && begin < values.size();
+       ++slot, begin += span)
+    inner->children[slot] = build(values, begin, depth - 1);
+  return inner;
+}
+
+// Returns a copy of node with the value at index replaced, sharing every
+// subtree off the path.
+std::shared_ptr<const void> assign(const std::shared_ptr<const void> &node,
+                                   unsigned depth, size_t index,
+                                   std::shared_ptr<Expressions> value) {
+  if (depth == 0) {
+    auto leaf = std::make_shared<Leaf>(*static_cast<const Leaf *>(node.get()));
+    leaf->values[slotOf(index, 0)] = std::move(value);
+    return leaf;
+  }
+  auto inner =
+      std::make_shared<Inner>(*static_cast<const Inner *>(node.get()));
+  auto &child = inner->children[slotOf(index, depth)];
+  child = assign(child, depth - 1, index, std::move(value));
+  return inner;
+}
+
+} // namespace
+
+// A default constructed memory has no parameters: names are looked up in an
+// empty map and no slot passes check(), so its trie is never reached.
+SymbolicMemory::SymbolicMemory() {
+  static const auto none =
+      std::make_shared<const std::unordered_map<std::string, size_t>>();
+  parameters = none;
+}
+
+void SymbolicMemory::check(size_t index) const {
+  if (index >= size())
+    throw std::runtime_error("memory access fault: slot " +
+                             std::to_string(index));
+}
+
+SymbolicMemory::SymbolicMemory(std::shared_ptr<const Function> function,
+                               ExprFactory &factory)
     : function(std::move(function)) {
-  data.reserve(this->function->parameters.size());
+  auto slots = std::make_shared<std::unordered_map<std::string, size_t>>();
+  std::vector<std::shared_ptr<Expressions>> values;
+  values.reserve(this->function->parameters.size());
   for (const Parameter &parameter : this->function->parameters) {
-    size_t index = data.size();
-    parameters.try_emplace(parameter.name, index);   
+    size_t index = values.size();
+    slots->try_emplace(parameter.name, index);   
     switch (parameter.type) {
     case T_BOOL:
-      data.emplace_back(std::make_shared<BoolSymbol>(parameter.name)); 
+      values.emplace_back(
+          factory.boolSymbol(parameter.name, static_cast<uint32_t>(index))); 
       break;
     case T_INT:
-      data.emplace_back(std::make_shared<IntSymbol>(parameter.name));
+      values.emplace_back(
+          factory.intSymbol(parameter.name, static_cast<uint32_t>(index)));
       break;
     }
   }
+  parameters = std::move(slots);
+  while ((size_t(1) << (FanoutBits * (depth + 1))) < values.size())
+    ++depth;
+  root = build(values, 0, depth);
 }
 
-void SymbolicMemory::save(cereal::JSONOutputArchive &out) const {
-  out(cereal::make_size_tag(data.size()));
-  for (size_t index = 0; index < data.size(); ++index) {
-    out.startNode();
-    out(cereal::make_nvp("name", function->parameters[index].name),
-        cereal::make_nvp("value", *data[index]));
-    out.finishNode();
-  }
+size_t SymbolicMemory::size() const {
+  return function ? function->parameters.size() : 0;
+}
+
+const std::string &SymbolicMemory::name(size_t index) const {
+  check(index);
+  return function->parameters[index].name;
+}
+
+std::shared_ptr<Expressions> SymbolicMemory::get(size_t index) const {
+  check(index);
+  const void *node = root.get();
+  for (unsigned level = depth; level > 0; --level)
+    node = static_cast<const Inner *>(node)
+               ->children[slotOf(index, level)]
+               .get();
+  return static_cast<const Leaf *>(node)->values[slotOf(index, 0)];
 }
 
 std::shared_ptr<Expressions> SymbolicMemory::get(const std::string &identifier) const {
-  auto it = parameters.find(identifier);
-  if (it == parameters.end()) {
+  auto it = parameters->find(identifier);
+  if (it == parameters->end()) {
     throw std::runtime_error("memory access fault: " + identifier);
   }
-  return data[it->second];
+  return get(it->second);
+}
+
+void SymbolicMemory::set(size_t index, std::shared_ptr<Expressions> value) {
+  // values are interned, so rewriting a slot with its own value is common
+  if (get(index) == value)
+    return;
+  root = assign(root, depth, index, std::move(value));
 }
 
 void SymbolicMemory::set(const std::string &identifier, std::shared_ptr<Expressions> value) {
-  auto it = parameters.find(identifier);
-  if (it == parameters.end()) {
+  auto it = parameters->find(identifier);
+  if (it == parameters->end()) {
     throw std::runtime_error("memory assign fault: " + identifier);
   }
-  data[it->second] = std::move(value);
+  set(it->second, std::move(value));
 }
@@ -5,32 +5,43 @@
 #include <unordered_map>
 #include <vector>
 
-namespace cereal {
-class JSONOutputArchive;
-}
-
 namespace mysym {
 
+class ExprFactory;
 struct Expressions;
 struct Function;
 
+// Values of the function parameters along one path. Copies share structure:
+// the name-to-slot map is built once per Function and never changes, and the
+// values live in a persistent 16-ary trie where set() copies only the nodes
+// on the path to the slot. Forking a path is therefore O(1), and memory grows
+// with the number of writes rather than with paths times variables.
 class SymbolicMemory {
 public:
   SymbolicMemory();
-  explicit SymbolicMemory(std::shared_ptr<const Function> function);
+  SymbolicMemory(std::shared_ptr<const Function> function,
+                 ExprFactory &factory);
   ~SymbolicMemory() = default; 
 
-  void save(cereal::JSONOutputArchive &out) const;
-
-  
   std::shared_ptr<Expressions> get(const std::string &identifier) const;
+  std::shared_ptr<Expressions> get(size_t index) const;
   
   void set(const std::string &identifier, std::shared_ptr<Expressions> value);
+  void set(size_t index, std::shared_ptr<Expressions> value);
+
+  size_t size() const;
+  // the name of the parameter held in a slot
+  const std::string &name(size_t index) const;
 
 private:
+  // throws std::runtime_error unless index is below size()
+  void check(size_t index) const;
+
   std::shared_ptr<const Function> function;
-  std::vector<std::shared_ptr<Expressions>> data;
-  std::unordered_map<std::string, size_t> parameters;
+  std::shared_ptr<const std::unordered_map<std::string, size_t>> parameters;
+  // a leaf when depth is 0, an inner node otherwise
+  std::shared_ptr<const void> root;
+  unsigned depth = 0;
 };
 
 } 
@@ -1534,3 +1534,111 @@ f(): bool {
   failTest();
 }
 
+
+TEST_F(ASTBuilderTest, KindTags_Expressions) {
+  setSource(R"(
+f(int a, bool b): bool {
+  return !b | a + 1 < 2 & true
+}
+)");
+  buildAST();
+  auto *lor = dynamic_cast<const BinOp *>(ast->returnValue.get());
+  ASSERT_NE(nullptr, lor);
+  EXPECT_EQ(EK_BinOp, lor->exprKind);
+  EXPECT_EQ(EK_UnOp, lor->lhs->exprKind);
+  EXPECT_EQ(EK_VarRef,
+            static_cast<const UnOp &>(*lor->lhs).subExpr->exprKind);
+  auto *land = dynamic_cast<const BinOp *>(lor->rhs.get());
+  ASSERT_NE(nullptr, land);
+  EXPECT_EQ(EK_BinOp, land->lhs->exprKind);
+  EXPECT_EQ(EK_BoolConstant, land->rhs->exprKind);
+  auto *less = dynamic_cast<const BinOp *>(land->lhs.get());
+  ASSERT_NE(nullptr, less);
+  EXPECT_EQ(EK_IntConstant, less->rhs->exprKind);
+}
+
+TEST_F(ASTBuilderTest, KindTags_Statements) {
+  setSource(R"(
+f(int a): int {
+  a = 1
+  if (a < 0) {} else {}
+  return a
+}
+)");
+  buildAST();
+  ASSERT_EQ(2u, ast->body.size());
+  EXPECT_EQ(SK_Assignment, ast->body[0]->stmtKind);
+  EXPECT_EQ(SK_If, ast->body[1]->stmtKind);
+}
+
+TEST_F(ASTBuilderTest, Slots_ResolvedToParameterIndices) {
+  setSource(R"(
+f(int a, bool b, int c): int {
+  c = a
+  return c
+}
+)");
+  buildAST();
+  ASSERT_EQ(1u, ast->body.size());
+  auto &assignment = static_cast<const Assignment &>(*ast->body[0]);
+  EXPECT_EQ(2u, assignment.slot);
+  EXPECT_EQ(0u, static_cast<const VarRef &>(*assignment.value).slot);
+  EXPECT_EQ(2u, static_cast<const VarRef &>(*ast->returnValue).slot);
+}
+
+TEST_F(ASTBuilderTest, FlatCode_NotEmittedByDefault) {
+  setSource(R"(
+f(int a): int {
+  return a + 1
+}
+)");
+  buildAST();
+  EXPECT_EQ(nullptr, ast->code);
+}
+
+TEST_F(ASTBuilderTest, FlatCode_PostOrder) {
+  builder = IASTBuilder::create(/*emitFlatCode=*/true);
+  setSource(R"(
+f(int a, bool b): bool {
+  a = a - 2
+  if (!b) {} else {}
+  return a + 1 < a & b
+}
+)");
+  buildAST();
+  ASSERT_NE(nullptr, ast->code);
+  const std::vector<FlatNode> &nodes = ast->code->nodes;
+  ASSERT_EQ(12u, nodes.size());
+
+  auto *assignment = dynamic_cast<const Assignment *>(ast->body[0].get());
+  ASSERT_NE(nullptr, assignment);
+  EXPECT_EQ(0u, assignment->valueCode.begin);
+  EXPECT_EQ(3u, assignment->valueCode.end);
+  EXPECT_EQ(FO_VarRef, nodes[0].opcode);
+  EXPECT_EQ(0, nodes[0].value);
+  EXPECT_EQ(FO_IntConstant, nodes[1].opcode);
+  EXPECT_EQ(2, nodes[1].value);
+  EXPECT_EQ(FO_Sub, nodes[2].opcode);
+  EXPECT_EQ(0u, nodes[2].lhs);
+  EXPECT_EQ(1u, nodes[2].rhs);
+
+  auto *ifstmt = dynamic_cast<const IfStmt *>(ast->body[1].get());
+  ASSERT_NE(nullptr, ifstmt);
+  EXPECT_EQ(3u, ifstmt->conditionCode.begin);
+  EXPECT_EQ(5u, ifstmt->conditionCode.end);
+  EXPECT_EQ(FO_VarRef, nodes[3].opcode);
+  EXPECT_EQ(1, nodes[3].value);
+  EXPECT_EQ(FO_Neg, nodes[4].opcode);
+  EXPECT_EQ(3u, nodes[4].lhs);
+
+  EXPECT_EQ(5u, ast->returnCode.begin);
+  EXPECT_EQ(12u, ast->returnCode.end);
+  EXPECT_EQ(FO_Add, nodes[7].opcode);
+  EXPECT_EQ(FO_Lt, nodes[9].opcode);
+  EXPECT_EQ(7u, nodes[9].lhs);
+  EXPECT_EQ(8u, nodes[9].rhs);
+  EXPECT_EQ(FO_LAnd, nodes[11].opcode);
+  EXPECT_EQ(T_BOOL, nodes[11].type);
+  EXPECT_EQ(9u, nodes[11].lhs);
+  EXPECT_EQ(10u, nodes[11].rhs);
+}
@@ -1,5 +1,10 @@
+#include "ExprFactory.h"
 #include "Expressions.h"
+#include "Renderer.h"
+#include "cereal/archives/json.hpp"
 #include "gtest/gtest.h"
+#include <sstream>
+#include <thread>
 
 using namespace mysym;
 
@@ -126,4 +131,332 @@ TEST(SymExprRender, BoolAndAfterIntCmp) {
       std::make_shared<IntGreater>(std::make_shared<IntSymbol>("z"),
                                    std::make_shared<IntConst>(10)));
   EXPECT_EQ("((a < b) & (z > 10))", render(*expr));
-}
\ No newline at end of file
+}
+
+TEST(SymExprRender, IntIte) {
+  auto expr = std::make_shared<IntIte>(
+      std::make_shared<BoolSymbol>("b"), std::make_shared<IntSymbol>("x"),
+      std::make_shared<IntConst>(1));
+  EXPECT_EQ("(b ? x : 1)", render(*expr));
+}
+
+TEST(SymExprRender, BoolIteAfterIntCmp) {
+  auto x = std::make_shared<IntSymbol>("x");
+  auto expr = std::make_shared<BoolIte>(
+      std::make_shared<IntLess>(x, std::make_shared<IntConst>(0)),
+      std::make_shared<BoolSymbol>("p"),
+      std::make_shared<BoolNeg>(std::make_shared<BoolSymbol>("q")));
+  EXPECT_EQ("((x < 0) ? p : !q)", render(*expr));
+}
+
+TEST(SymExprSerialize, IteSavedAsRenderedString) {
+  ExprFactory factory;
+  auto ite = factory.intIte(factory.boolSymbol("b"), factory.intSymbol("x"),
+                            factory.intConst(1));
+  std::ostringstream stream;
+  {
+    cereal::JSONOutputArchive archive(stream);
+    archive(cereal::make_nvp("value", *ite));
+  }
+  EXPECT_NE(std::string::npos, stream.str().find("\"(b ? x : 1)\""));
+}
+
+TEST(SymExprFactory, InternsLeaves) {
+  ExprFactory factory;
+  EXPECT_EQ(factory.intSymbol("x"), factory.intSymbol("x"));
+  EXPECT_EQ(factory.intConst(42), factory.intConst(42));
+  EXPECT_EQ(factory.boolConst(true), factory.boolConst(true));
+  EXPECT_NE(factory.intSymbol("x"), factory.intSymbol("y"));
+  EXPECT_NE(factory.boolConst(true), factory.boolConst(false));
+}
+
+TEST(SymExprFactory, InternsStructurallyEqualTrees) {
+  ExprFactory factory;
+  auto lhs = factory.intLess(
+      factory.intAdd(factory.intSymbol("a"), factory.intConst(1)),
+      factory.intSymbol("b"));
+  auto rhs = factory.intLess(
+      factory.intAdd(factory.intSymbol("a"), factory.intConst(1)),
+      factory.intSymbol("b"));
+  EXPECT_EQ(lhs, rhs);
+  EXPECT_EQ("((a + 1) < b)", render(*lhs));
+  EXPECT_NE(lhs, factory.intGreater(
+                     factory.intAdd(factory.intSymbol("a"), factory.intConst(1)),
+                     factory.intSymbol("b")));
+}
+
+TEST(SymExprFactory, DistinguishesSymbolSorts) {
+  ExprFactory factory;
+  std::shared_ptr<Expressions> intSymbol = factory.intSymbol("v");
+  std::shared_ptr<Expressions> boolSymbol = factory.boolSymbol("v");
+  EXPECT_NE(intSymbol, boolSymbol);
+}
+
+TEST(SymExprFactory, ConjunctionOfEmptyIsTrue) {
+  ExprFactory factory;
+  EXPECT_EQ(factory.boolConst(true), conjunction(factory, {}));
+}
+
+TEST(SymExprFactory, NodesOutliveFactory) {
+  std::shared_ptr<BoolExpression> expr;
+  std::shared_ptr<IntExpression> sum;
+  {
+    ExprFactory factory;
+    expr = factory.boolAnd(factory.boolSymbol("p"),
+                           factory.boolNeg(factory.boolSymbol("q")));
+    sum = factory.intAdd(factory.intSymbol("x"), factory.intConst(1));
+    EXPECT_GT(factory.bytesAllocated(), 0u);
+  }
+  EXPECT_EQ("(p & !q)", render(*expr));
+  EXPECT_EQ("(x + 1)", render(*sum));
+  // the last node of an arena releases it
+  expr.reset();
+  EXPECT_EQ("(x + 1)", render(*sum));
+}
+
+TEST(SymExprFactory, InternsAcrossThreads) {
+  ExprFactory factory;
+  auto build = [&factory] {
+    std::vector<std::shared_ptr<BoolExpression>> built;
+    for (int64_t value = 0; value < 200; ++value)
+      built.push_back(factory.intLess(
+          factory.intAdd(factory.intSymbol("x"), factory.intConst(value)),
+          factory.intSymbol("y")));
+    return built;
+  };
+  std::vector<std::vector<std::shared_ptr<BoolExpression>>> results(4);
+  std::vector<std::thread> threads;
+  for (auto &result : results)
+    threads.emplace_back([&] { result = build(); });
+  for (std::thread &thread : threads)
+    thread.join();
+  for (const auto &result : results)
+    EXPECT_EQ(results.front(), result);
+  EXPECT_EQ(results.front(), build());
+}
+
+TEST(SymExprArena, GrowsBeyondChunkSize) {
+  ExprArena arena(16);
+  void *small = arena.allocate(8, 8);
+  void *large = arena.allocate(100, 16);
+  EXPECT_NE(small, large);
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(large) % 16);
+  EXPECT_EQ(108u, arena.bytesAllocated());
+}
+
+TEST(SymExprArena, ReusesFreedBlocks) {
+  ExprArena arena(1024);
+  void *first = arena.allocate(48, 8);
+  arena.allocate(48, 8);
+  arena.deallocate(first, 48);
+  EXPECT_EQ(48u, arena.bytesAllocated());
+  EXPECT_EQ(first, arena.allocate(48, 8));
+  EXPECT_NE(first, arena.allocate(48, 8));
+}
+
+TEST(SymExprFactory, DropsNodesNothingHolds) {
+  ExprFactory factory;
+  auto x = factory.intSymbol("x");
+  auto kept = factory.intLess(x, factory.intConst(-1));
+  for (int64_t value = 0; value < 200000; ++value)
+    factory.intLess(x, factory.intConst(value));
+  // only what the last collection kept and what was built since
+  EXPECT_LT(factory.size(), 100000u);
+  EXPECT_LT(factory.bytesAllocated(), 100000u * 128);
+  EXPECT_EQ(kept, factory.intLess(x, factory.intConst(-1)));
+  EXPECT_EQ(x, factory.intSymbol("x"));
+  EXPECT_EQ("(x < -1)", render(*kept));
+}
+
+TEST(SymExprSimplify, FoldsIntConstants) {
+  ExprFactory factory;
+  EXPECT_EQ("3", render(*factory.intAdd(factory.intConst(1),
+                                        factory.intConst(2))));
+  EXPECT_EQ("-1", render(*factory.intSub(factory.intConst(1),
+                                         factory.intConst(2))));
+  EXPECT_EQ("true", render(*factory.intLess(factory.intConst(1),
+                                            factory.intConst(2))));
+  EXPECT_EQ("false", render(*factory.intGreater(factory.intConst(1),
+                                                factory.intConst(2))));
+}
+
+TEST(SymExprSimplify, CancelsOppositeTerms) {
+  ExprFactory factory;
+  auto x = factory.intSymbol("x");
+  EXPECT_EQ("0", render(*factory.intSub(x, x)));
+  auto y = factory.intSymbol("y");
+  auto expr = factory.intSub(factory.intAdd(y, factory.intAdd(x, y)), y);
+  EXPECT_EQ("(x + y)", render(*expr));
+  EXPECT_EQ(factory.intAdd(x, y), expr);
+}
+
+TEST(SymExprSimplify, NormalizesSums) {
+  ExprFactory factory;
+  auto x = factory.intSymbol("x");
+  auto y = factory.intSymbol("y");
+  auto expr = factory.intAdd(
+      x, factory.intAdd(y, factory.intSub(x, factory.intConst(42))));
+  EXPECT_EQ("(2*x + y - 42)", render(*expr));
+  EXPECT_EQ("(-x - y + 5)",
+            render(*factory.intSub(factory.intConst(5), factory.intAdd(y, x))));
+  EXPECT_EQ("x", render(*factory.intAdd(x, factory.intConst(0))));
+}
+
+TEST(SymExprLinear, OrdersTermsBySymbolId) {
+  ExprFactory factory;
+  auto a = factory.intSymbol("b");
+  auto b = factory.intSymbol("a");
+  auto expr = factory.intAdd(b, a);
+  EXPECT_EQ(expr, factory.intAdd(a, b));
+  auto *linear = dynamic_cast<const LinearExpr *>(expr.get());
+  ASSERT_NE(nullptr, linear);
+  ASSERT_EQ(2u, linear->terms.size());
+  EXPECT_EQ(a, linear->terms[0].symbol);
+  EXPECT_EQ(b, linear->terms[1].symbol);
+  EXPECT_EQ("(b + a)", render(*expr));
+}
+
+TEST(SymExprLinear, SizeIndependentOfChainDepth) {
+  ExprFactory factory;
+  auto x = factory.intSymbol("x");
+  auto y = factory.intSymbol("y");
+  std::shared_ptr<IntExpression> value = x;
+  for (int i = 0; i < 100; ++i)
+    value = factory.intSub(factory.intAdd(value, factory.intAdd(y, x)),
+                           factory.intConst(1));
+  EXPECT_EQ("(101*x + 100*y - 100)", render(*value));
+}
+
+TEST(SymExprLinear, TakesSumOperandsAsBuilt) {
+  ExprFactory factory;
+  auto x = factory.intSymbol("x");
+  auto y = factory.intSymbol("y");
+  // as after merging states, every sum keeps the ite as an operand
+  std::shared_ptr<IntExpression> value =
+      factory.intIte(factory.boolSymbol("b"), x, factory.intConst(1));
+  for (int i = 0; i < 10000; ++i) {
+    auto previous = value;
+    value = factory.intSub(value, y);
+    auto *sum = dynamic_cast<const IntSub *>(value.get());
+    ASSERT_NE(nullptr, sum);
+    ASSERT_EQ(previous, sum->lhs);
+  }
+
+  // sums are not looked into, so arithmetic built by hand is left as it is
+  auto raw = std::make_shared<IntSub>(
+      std::make_shared<IntAdd>(x, std::make_shared<IntConst>(3)), x);
+  auto *sum = dynamic_cast<const IntAdd *>(factory.intAdd(raw, y).get());
+  ASSERT_NE(nullptr, sum);
+  EXPECT_EQ(raw, sum->lhs);
+}
+
+TEST(SymExprLinear, KeepsIteOperandsOpaque) {
+  ExprFactory factory;
+  auto x = factory.intSymbol("x");
+  auto ite = factory.intIte(factory.boolSymbol("b"), x, factory.intConst(1));
+  auto sum = factory.intAdd(ite, factory.intAdd(x, factory.intConst(2)));
+  EXPECT_NE(nullptr, dynamic_cast<const IntAdd *>(sum.get()));
+  EXPECT_EQ(sum, factory.intAdd(ite, factory.intAdd(factory.intConst(2), x)));
+  EXPECT_EQ("((b ? x : 1) + (x + 2))", render(*sum));
+}
+
+TEST(SymExprRender, LinearExpr) {
+  auto x = std::make_shared<IntSymbol>("x", 0);
+  auto y = std::make_shared<IntSymbol>("y", 1);
+  EXPECT_EQ("(2*x - y - 1)",
+            render(LinearExpr({{x, 2}, {y, -1}}, -1)));
+  EXPECT_EQ("(-x + 1)", render(LinearExpr({{x, -1}}, 1)));
+  EXPECT_EQ("(3*y)", render(LinearExpr({{y, 3}}, 0)));
+}
+
+TEST(SymExprSimplify, BoolIdentities) {
+  ExprFactory factory;
+  auto b = factory.boolSymbol("b");
+  auto t = factory.boolConst(true);
+  auto f = factory.boolConst(false);
+  EXPECT_EQ(b, factory.boolNeg(factory.boolNeg(b)));
+  EXPECT_EQ(f, factory.boolNeg(t));
+  EXPECT_EQ(b, factory.boolAnd(b, t));
+  EXPECT_EQ(f, factory.boolAnd(f, b));
+  EXPECT_EQ(f, factory.boolAnd(b, factory.boolNeg(b)));
+  EXPECT_EQ(b, factory.boolOr(f, b));
+  EXPECT_EQ(t, factory.boolOr(b, t));
+  EXPECT_EQ(t, factory.boolOr(factory.boolNeg(b), b));
+  EXPECT_EQ(b, factory.boolAnd(b, b));
+}
+
+TEST(SymExprSimplify, ComparisonOfEqualOperands) {
+  ExprFactory factory;
+  auto x = factory.intSymbol("x");
+  EXPECT_EQ(factory.boolConst(false), factory.intLess(x, x));
+  EXPECT_EQ(factory.boolConst(false), factory.intGreater(x, x));
+}
+
+TEST(SymExprSimplify, IteRules) {
+  ExprFactory factory;
+  auto b = factory.boolSymbol("b");
+  auto c = factory.boolSymbol("c");
+  auto x = factory.intSymbol("x");
+  auto y = factory.intSymbol("y");
+  auto t = factory.boolConst(true);
+  auto f = factory.boolConst(false);
+
+  EXPECT_EQ(x, factory.intIte(b, x, x));
+  EXPECT_EQ(x, factory.intIte(t, x, y));
+  EXPECT_EQ(y, factory.intIte(f, x, y));
+  EXPECT_EQ(factory.intIte(b, y, x), factory.intIte(factory.boolNeg(b), x, y));
+  auto inner = factory.intIte(b, x, y);
+  EXPECT_EQ(factory.intIte(b, x, factory.intConst(1)),
+            factory.intIte(b, inner, factory.intConst(1)));
+  EXPECT_EQ(factory.intIte(b, factory.intConst(1), y),
+            factory.intIte(b, factory.intConst(1), inner));
+  EXPECT_EQ("(b ? x : y)", render(*inner));
+
+  EXPECT_EQ(c, factory.boolIte(b, c, c));
+  EXPECT_EQ(c, factory.boolIte(t, c, b));
+  EXPECT_EQ(b, factory.boolIte(b, t, f));
+  EXPECT_EQ(factory.boolNeg(b), factory.boolIte(b, f, t));
+  EXPECT_EQ(factory.boolOr(b, c), factory.boolIte(b, t, c));
+  EXPECT_EQ(factory.boolAnd(b, c), factory.boolIte(b, c, f));
+  EXPECT_EQ("(b ? c : !c)",
+            render(*factory.boolIte(b, c, factory.boolNeg(c))));
+}
+
+TEST(SymExprRender, DeepChains) {
+  ExprFactory factory;
+  auto x = factory.intSymbol("x");
+  std::shared_ptr<IntExpression> expr = x;
+  for (int i = 0; i < 20000; ++i)
+    expr = factory.intIte(factory.intLess(x, factory.intConst(i)), expr,
+                          factory.intConst(i));
+  std::string text = render(*expr);
+  EXPECT_EQ(0u, text.find("((x < 19999) ? ((x < 19998) ? "));
+  EXPECT_NE(std::string::npos, text.find("((x < 0) ? x : 0) : 1) : 2)"));
+  EXPECT_EQ(text.size() - 9, text.rfind(" : 19999)"));
+}
+
+TEST(SymExprRender, SharedSubexpressions) {
+  ExprFactory factory;
+  auto b = factory.boolSymbol("b");
+  auto x = factory.intSymbol("x");
+  auto y = factory.intSymbol("y");
+  auto ite = factory.intIte(b, x, y);
+  auto sum = factory.intAdd(ite, ite);
+  auto expr = factory.boolAnd(factory.intLess(sum, factory.intConst(3)),
+                              factory.boolNeg(factory.intGreater(ite, sum)));
+  EXPECT_EQ("((((b ? x : y) + (b ? x : y)) < 3) & "
+            "!((b ? x : y) > ((b ? x : y) + (b ? x : y))))",
+            render(*expr));
+  EXPECT_EQ("let #0 = (b ? x : y), #1 = (#0 + #0) in "
+            "((#1 < 3) & !(#0 > #1))",
+            render(*expr, ES_Shared));
+  // nothing shared, nothing bound
+  EXPECT_EQ("(b ? x : y)", render(*ite, ES_Shared));
+
+  Renderer renderer;
+  fmt::memory_buffer out;
+  renderer.render(*sum, out, ES_Shared);
+  renderer.render(*ite, out);
+  EXPECT_EQ("let #0 = (b ? x : y) in (#0 + #0)(b ? x : y)",
+            fmt::to_string(out));
+}
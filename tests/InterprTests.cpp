@@ -2,10 +2,15 @@
 #include "ASTBuilder.h"
 #include "LangLexer.h"
 #include "LangParser.h"
+#include "ExprFactory.h"
 #include "Interpreter.h"
+#include "ResultFormat.h"
 #include "cereal/archives/json.hpp"
 #include "cereal/types/vector.hpp"
 #include "gtest/gtest.h"
+#include <filesystem>
+#include <fstream>
+#include <random>
 
 using namespace antlr4;
 using namespace mysym;
@@ -36,7 +41,7 @@ protected:
     ASSERT_EQ(0ULL, parser.getNumberOfSyntaxErrors());
     tree::ParseTreeWalker::DEFAULT.walk(builder.get(), tree);
     ast = builder->getFunction();
-    executionResults = execute(ast);
+    executionResults = execute(ast, options);
   }
 
   rapidjson::Document getResults() {
@@ -56,6 +61,7 @@ protected:
   LangParser parser;
   std::shared_ptr<IASTBuilder> builder = IASTBuilder::create();
   std::shared_ptr<Function> ast;
+  ExecutionOptions options;
   std::vector<SymbolicExecutionResult> executionResults;
 };
 
@@ -320,31 +326,692 @@ f(int x, int y): int {
     "values": [
       {
         "name": "x",
-        "value": "((x + (y + (x - 42))) + x)"
+        "value": "(3*x + y - 42)"
       },
       {
         "name": "y",
-        "value": "(x + (y + (x - 42)))"
+        "value": "(2*x + y - 42)"
       }
     ],
     "pc": "(x < 0)",
-    "result": "(x + (y + (x - 42)))"
+    "result": "(2*x + y - 42)"
   },
   {
     "values": [
       {
         "name": "x",
-        "value": "((y - (x - (x + 42))) - x)"
+        "value": "(-x + y + 42)"
       },
       {
         "name": "y",
-        "value": "(y - (x - (x + 42)))"
+        "value": "(y + 42)"
       }
     ],
     "pc": "!(x < 0)",
-    "result": "(y - (x - (x + 42)))"
+    "result": "(y + 42)"
   }
 ]
 )json");
   EXPECT_EQ(expected, results);
-}
\ No newline at end of file
+}
+
+TEST_F(SymInterpreterTest, SlidesExampleFlatCode) {
+  builder = IASTBuilder::create(/*emitFlatCode=*/true);
+  setSource(R"(
+f(int x, int y): int {
+  if (x < 0) {
+    y = x + y + x - 42
+    x = y + x
+  } else {
+    y = y - x - x + 42
+    x = y - x
+  }
+  return y
+}
+)");
+  act();
+  ASSERT_NE(nullptr, ast->code);
+  rapidjson::Document results = getResults();
+  rapidjson::Document expected;
+  expected.Parse(R"json(
+[
+  {
+    "values": [
+      {
+        "name": "x",
+        "value": "(3*x + y - 42)"
+      },
+      {
+        "name": "y",
+        "value": "(2*x + y - 42)"
+      }
+    ],
+    "pc": "(x < 0)",
+    "result": "(2*x + y - 42)"
+  },
+  {
+    "values": [
+      {
+        "name": "x",
+        "value": "(-x + y + 42)"
+      },
+      {
+        "name": "y",
+        "value": "(y + 42)"
+      }
+    ],
+    "pc": "!(x < 0)",
+    "result": "(y + 42)"
+  }
+]
+)json");
+  EXPECT_EQ(expected, results);
+}
+
+TEST_F(SymInterpreterTest, SimplifiesDuringEvaluation) {
+  setSource(R"(
+f(int x, bool b): bool {
+  x = x - x + 1 + 2
+  b = !!b & true
+  return b | !b
+}
+)");
+  act();
+  rapidjson::Document results = getResults();
+  rapidjson::Document expected;
+  expected.Parse(R"json(
+[
+  {
+    "values": [
+      {
+        "name": "x",
+        "value": "-3"
+      },
+      {
+        "name": "b",
+        "value": "b"
+      }
+    ],
+    "pc": "true",
+    "result": "true"
+  }
+]
+)json");
+  EXPECT_EQ(expected, results);
+}
+
+TEST_F(SymInterpreterTest, PrunesContradictingBranches) {
+  setSource(R"(
+f(int x, bool b): int {
+  if (b) {} else {}
+  if (b) {
+    x = 1
+  } else {
+    x = 2
+  }
+  return x
+}
+)");
+  act();
+  rapidjson::Document results = getResults();
+  rapidjson::Document expected;
+  expected.Parse(R"json(
+[
+  {
+    "values": [
+      {
+        "name": "x",
+        "value": "1"
+      },
+      {
+        "name": "b",
+        "value": "b"
+      }
+    ],
+    "pc": "b",
+    "result": "1"
+  },
+  {
+    "values": [
+      {
+        "name": "x",
+        "value": "2"
+      },
+      {
+        "name": "b",
+        "value": "b"
+      }
+    ],
+    "pc": "!b",
+    "result": "2"
+  }
+]
+)json");
+  EXPECT_EQ(expected, results);
+}
+
+TEST_F(SymInterpreterTest, NoPruningWithoutFeasibilityChecker) {
+  setSource(R"(
+f(bool b): bool {
+  if (b) {} else {}
+  if (b) {} else {}
+  return b
+}
+)");
+  options.feasibility = nullptr;
+  act();
+  EXPECT_EQ(4u, executionResults.size());
+}
+
+TEST_F(SymInterpreterTest, ConsultsCustomFeasibilityChecker) {
+  class RejectNegations : public IFeasibilityChecker {
+  public:
+    bool isFeasible(
+        const std::vector<std::shared_ptr<BoolExpression>> &pc) override {
+      ++queries;
+      return !dynamic_cast<const BoolNeg *>(pc.back().get());
+    }
+    size_t queries = 0;
+  };
+  auto checker = std::make_shared<RejectNegations>();
+  setSource(R"(
+f(int x): int {
+  if (x < 0) {} else {}
+  if (x > 5) {} else {}
+  return x
+}
+)");
+  options.feasibility = checker;
+  act();
+  rapidjson::Document results = getResults();
+  ASSERT_EQ(1u, results.Size());
+  EXPECT_STREQ("((x < 0) & (x > 5))", results[0]["pc"].GetString());
+  EXPECT_EQ(4u, checker->queries);
+}
+
+TEST_F(SymInterpreterTest, PrunesArithmeticallyInfeasibleBranches) {
+  setSource(R"(
+f(int x): int {
+  if (x < 0) {} else {}
+  if (x > 5) {} else {}
+  return x
+}
+)");
+  act();
+  rapidjson::Document results = getResults();
+  ASSERT_EQ(3u, results.Size());
+  for (const auto &result : results.GetArray())
+    EXPECT_STRNE("((x < 0) & (x > 5))", result["pc"].GetString());
+}
+
+TEST_F(SymInterpreterTest, ParallelExplorationKeepsDeterministicOrder) {
+  setSource(R"(
+f(int x, int y, bool b): int {
+  if (x < y) { x = x + 1 } else { y = y + 1 }
+  if (b) { x = x + y } else {}
+  if (y > 3) { y = 0 } else { y = x }
+  return x + y
+}
+)");
+  act();
+  rapidjson::Document sequential = getResults();
+  ASSERT_EQ(8u, sequential.Size());
+
+  options.jobs = 4;
+  options.deterministicOrder = true;
+  executionResults = execute(ast, options);
+  EXPECT_EQ(sequential, getResults());
+}
+
+TEST_F(SymInterpreterTest, SearchStrategiesFindTheSamePaths) {
+  setSource(R"(
+f(int x, int y, bool b): int {
+  if (x < y) { x = x + 1 } else { y = y + 1 }
+  if (b) {
+    if (x > 0) { x = 0 } else {}
+  } else {}
+  if (y > 3) { y = 0 } else { y = x }
+  return x + y
+}
+)");
+  options.deterministicOrder = true;
+  act();
+  rapidjson::Document depthFirst = getResults();
+  ASSERT_EQ(11u, depthFirst.Size());
+
+  for (SearchStrategy search :
+       {SS_BreadthFirst, SS_RandomPath, SS_CoverageGuided}) {
+    options.search = search;
+    for (unsigned jobs : {1u, 3u}) {
+      options.jobs = jobs;
+      executionResults = execute(ast, options);
+      EXPECT_EQ(depthFirst, getResults()) << search << ' ' << jobs;
+    }
+  }
+}
+
+TEST_F(SymInterpreterTest, NestedBlocksResumeEnclosingBlock) {
+  setSource(R"(
+f(int x, int y): int {
+  if (x < 0) {
+    if (y > 0) {
+      y = 1
+    } else {
+      y = 2
+    }
+    x = y + 10
+  } else {
+    x = 3
+  }
+  y = x + y
+  return y
+}
+)");
+  act();
+  rapidjson::Document results = getResults();
+  ASSERT_EQ(3u, results.Size());
+  EXPECT_STREQ("((x < 0) & (y > 0))", results[0]["pc"].GetString());
+  EXPECT_STREQ("12", results[0]["result"].GetString());
+  EXPECT_STREQ("((x < 0) & !(y > 0))", results[1]["pc"].GetString());
+  EXPECT_STREQ("14", results[1]["result"].GetString());
+  EXPECT_STREQ("!(x < 0)", results[2]["pc"].GetString());
+  EXPECT_STREQ("(y + 3)", results[2]["result"].GetString());
+}
+
+TEST_F(SymInterpreterTest, MergesBranchesIntoIte) {
+  setSource(R"(
+f(int x, int y): int {
+  if (x < 0) { y = y + 1 } else { y = y - x }
+  return y
+}
+)");
+  options.merging = SM_QueryCount;
+  act();
+  rapidjson::Document results = getResults();
+  ASSERT_EQ(1u, results.Size());
+  EXPECT_STREQ("true", results[0]["pc"].GetString());
+  EXPECT_STREQ("((x < 0) ? (y + 1) : (-x + y))",
+               results[0]["result"].GetString());
+}
+
+TEST_F(SymInterpreterTest, MergedValuesStayCompact) {
+  setSource(R"(
+f(int x, bool b): bool {
+  if (x < 0) { b = true } else { b = false }
+  if (x > 5) { x = 1 } else { x = 1 }
+  return b
+}
+)");
+  options.merging = SM_Always;
+  act();
+  rapidjson::Document results = getResults();
+  ASSERT_EQ(1u, results.Size());
+  EXPECT_STREQ("true", results[0]["pc"].GetString());
+  EXPECT_STREQ("1", results[0]["values"][0]["value"].GetString());
+  EXPECT_STREQ("(x < 0)", results[0]["result"].GetString());
+}
+
+TEST_F(SymInterpreterTest, PrunesThroughMergedValues) {
+  setSource(R"(
+f(int x, int y): int {
+  if (x < 0) { y = 1 } else { y = 2 }
+  if (y > 1) {
+    if (x < 0) { y = 100 } else {}
+  } else {}
+  return y
+}
+)");
+  options.merging = SM_Always;
+  act();
+  rapidjson::Document results = getResults();
+  ASSERT_EQ(1u, results.Size());
+  EXPECT_STREQ("((x < 0) ? 1 : 2)", results[0]["result"].GetString());
+}
+
+TEST_F(SymInterpreterTest, KeepsPathsApartWhenConditionsReadMergedValue) {
+  setSource(R"(
+f(int x, int y): int {
+  if (x < 0) { y = 1 } else { y = 2 }
+  if (y > 1) { x = 0 } else {}
+  return x + y
+}
+)");
+  act();
+  rapidjson::Document separate = getResults();
+  ASSERT_EQ(2u, separate.Size());
+
+  options.merging = SM_QueryCount;
+  executionResults = execute(ast, options);
+  EXPECT_EQ(separate, getResults());
+}
+
+TEST_F(SymInterpreterTest, MaxDepthAbandonsDeeperPaths) {
+  setSource(R"(
+f(int x, int y): int {
+  if (x < 0) {
+    if (y < 0) {} else {}
+  } else {}
+  return x
+}
+)");
+  act();
+  ASSERT_EQ(3u, executionResults.size());
+
+  options.maxDepth = 1;
+  EXPECT_THROW(execute(ast, options), std::runtime_error);
+  ExecutionReport report = executeWithReport(ast, options);
+  ASSERT_EQ(1u, report.results.size());
+  EXPECT_EQ("!(x < 0)", render(*report.results[0].pc));
+  ASSERT_EQ(1u, report.abandoned.size());
+  EXPECT_EQ(AR_MaxDepth, report.abandoned[0].reason);
+  EXPECT_EQ("(x < 0)", render(*report.abandoned[0].pc));
+  EXPECT_EQ(1u, report.abandoned[0].depth);
+}
+
+TEST_F(SymInterpreterTest, MaxResultsStopsExploration) {
+  setSource(R"(
+f(int x, int y, bool b): int {
+  if (x < 0) {} else {}
+  if (y < 0) {} else {}
+  if (b) {} else {}
+  return x
+}
+)");
+  act();
+  ASSERT_EQ(8u, executionResults.size());
+
+  options.maxResults = 3;
+  ExecutionReport report = executeWithReport(ast, options);
+  EXPECT_EQ(3u, report.results.size());
+  EXPECT_FALSE(report.abandoned.empty());
+  for (const AbandonedState &state : report.abandoned)
+    EXPECT_EQ(AR_MaxResults, state.reason);
+}
+
+TEST_F(SymInterpreterTest, TimeoutReturnsPartialResults) {
+  // 2^24 paths cannot be explored within a millisecond
+  std::string parameters;
+  std::string body;
+  for (int i = 0; i < 24; ++i) {
+    std::string name = "p" + std::to_string(i);
+    parameters += (i ? ", int " : "int ") + name;
+    body += "  if (" + name + " < 0) {} else {}\n";
+  }
+  setSource("f(" + parameters + "): int {\n" + body + "  return p0\n}\n");
+  tree::ParseTreeWalker::DEFAULT.walk(builder.get(), parser.function());
+  ast = builder->getFunction();
+
+  options.timeout = std::chrono::milliseconds(1);
+  ExecutionReport report = executeWithReport(ast, options);
+  EXPECT_LT(report.results.size(), size_t(1) << 24);
+  ASSERT_FALSE(report.abandoned.empty());
+  for (const AbandonedState &state : report.abandoned)
+    EXPECT_EQ(AR_Timeout, state.reason);
+}
+
+#ifdef __linux__
+TEST_F(SymInterpreterTest, MemoryLimitAbandonsStates) {
+  setSource(R"(
+f(int x): int {
+  if (x < 0) {} else {}
+  return x
+}
+)");
+  act();
+  options.maxResidentBytes = 1;
+  ExecutionReport report = executeWithReport(ast, options);
+  EXPECT_TRUE(report.results.empty());
+  ASSERT_EQ(1u, report.abandoned.size());
+  EXPECT_EQ(AR_MemoryLimit, report.abandoned[0].reason);
+}
+#endif
+
+namespace {
+
+class RecordingSink : public IResultSink {
+public:
+  void accept(SymbolicExecutionResult result) override {
+    if (results.size() == limit)
+      throw std::runtime_error("sink is full");
+    results.push_back(std::move(result));
+  }
+
+  std::vector<SymbolicExecutionResult> results;
+  size_t limit = -1;
+};
+
+} 
+
+TEST_F(SymInterpreterTest, StreamsResultsToSink) {
+  setSource(R"(
+f(int x, int y, bool b): int {
+  if (x < 0) { y = y + 1 } else {}
+  if (y < x) { x = y } else {}
+  if (b) { y = 0 } else {}
+  return x + y
+}
+)");
+  options.deterministicOrder = true;
+  act();
+  rapidjson::Document expected = getResults();
+
+  for (unsigned jobs : {1u, 3u}) {
+    options.jobs = jobs;
+    RecordingSink sink;
+    EXPECT_TRUE(execute(ast, sink, options).empty());
+    executionResults = std::move(sink.results);
+    EXPECT_EQ(expected, getResults()) << jobs;
+  }
+
+  // results reach the sink while exploration is still going on
+  options.jobs = 1;
+  RecordingSink sink;
+  sink.limit = 2;
+  EXPECT_THROW(execute(ast, sink, options), std::runtime_error);
+  EXPECT_EQ(2u, sink.results.size());
+}
+
+TEST_F(SymInterpreterTest, WritesResultsAsNdJson) {
+  setSource(R"(
+f(int x, bool b): int {
+  if (x < 0) { x = 0 - x } else {}
+  if (b) { x = x + 1 } else {}
+  return x
+}
+)");
+  act();
+  rapidjson::Document expected = getResults();
+
+  std::stringstream stream;
+  {
+    auto writer = ResultWriter::create(RF_NdJson, stream);
+    for (const SymbolicExecutionResult &result : executionResults)
+      writer->accept(result);
+    writer->finish();
+  }
+  std::string line;
+  rapidjson::SizeType index = 0;
+  while (std::getline(stream, line)) {
+    ASSERT_LT(index, expected.Size());
+    rapidjson::Document document;
+    document.Parse(line.c_str());
+    EXPECT_EQ(expected[index++], document) << line;
+  }
+  EXPECT_EQ(expected.Size(), index);
+}
+
+TEST_F(SymInterpreterTest, BinaryResultsReadBack) {
+  setSource(R"(
+f(int x, int y, bool b): int {
+  if (x < y) { x = x + y } else { y = 0 - x }
+  if (b) { y = y + 1 } else {}
+  return x + y
+}
+)");
+  act();
+
+  std::stringstream stream;
+  {
+    auto writer = ResultWriter::create(RF_Binary, stream);
+    for (const SymbolicExecutionResult &result : executionResults)
+      writer->accept(result);
+    writer->finish();
+  }
+  ResultReader reader(stream);
+  std::vector<StoredResult> stored;
+  for (StoredResult result; reader.next(result);)
+    stored.push_back(result);
+  ASSERT_EQ(executionResults.size(), stored.size());
+  for (size_t index = 0; index < stored.size(); ++index) {
+    const SymbolicExecutionResult &result = executionResults[index];
+    EXPECT_EQ(render(*result.pc), render(*stored[index].pc));
+    EXPECT_EQ(render(*result.result), render(*stored[index].result));
+    ASSERT_EQ(result.memory.size(), stored[index].values.size());
+    for (size_t slot = 0; slot < result.memory.size(); ++slot) {
+      EXPECT_EQ(result.memory.name(slot), stored[index].values[slot].first);
+      EXPECT_EQ(render(*result.memory.get(slot)),
+                render(*stored[index].values[slot].second));
+    }
+  }
+  // the symbol b and the first branch condition were written once
+  EXPECT_EQ(stored[0].values[2].second, stored[1].values[2].second);
+  auto firstCondition = [](const StoredResult &result) {
+    auto &conjunction = dynamic_cast<const BoolAnd &>(*result.pc);
+    return conjunction.lhs;
+  };
+  EXPECT_EQ(firstCondition(stored[0]), firstCondition(stored[1]));
+
+  std::stringstream truncated(stream.str().substr(0, stream.str().size() - 1));
+  ResultReader partial(truncated);
+  StoredResult result;
+  EXPECT_THROW(while (partial.next(result)) {}, std::runtime_error);
+  std::stringstream json("[]");
+  EXPECT_THROW(ResultReader{json}, std::runtime_error);
+  // a name claiming far more bytes than the file holds
+  std::stringstream hugeName(stream.str().substr(0, 9) +
+                             "\x01\xff\xff\xff\xff\xff\xff\xff\x7f" +
+                             "abc");
+  ResultReader lying(hugeName);
+  EXPECT_THROW(lying.next(result), std::runtime_error);
+
+  std::ofstream closed;
+  auto failing = ResultWriter::create(RF_Binary, closed);
+  failing->accept(executionResults[0]);
+  EXPECT_THROW(failing->finish(), std::runtime_error);
+}
+
+TEST_F(SymInterpreterTest, IndexedResultsAreFoundByPath) {
+  setSource(R"(
+f(int x, int y): int {
+  if (x < 0) { y = y + x } else {}
+  if (y < 5) { x = 7 } else {}
+  return x + y
+}
+)");
+  act();
+
+  // unique, as several runs of the tests may share the directory
+  std::string name = "mysym-indexed-" +
+                     std::to_string(std::random_device()()) + ".idx";
+  std::string path =
+      (std::filesystem::path(::testing::TempDir()) / name).string();
+  {
+    std::ofstream out(path, std::ios::binary);
+    auto writer = ResultWriter::create(RF_Indexed, out);
+    for (const SymbolicExecutionResult &result : executionResults)
+      writer->accept(result);
+    writer->finish();
+  }
+  {
+    ResultFile file(path);
+    ASSERT_EQ(executionResults.size(), file.size());
+    ASSERT_EQ(2u, file.parameterCount());
+    EXPECT_EQ("y", file.parameterName(1));
+    // last path first: nothing depends on reading the earlier ones
+    for (size_t index = file.size(); index-- > 0;) {
+      const SymbolicExecutionResult &result = executionResults[index];
+      StoredResult stored = file.load(index);
+      EXPECT_EQ(render(*result.pc), render(*stored.pc));
+      EXPECT_EQ(render(*result.result), render(*stored.result));
+      for (size_t slot = 0; slot < result.memory.size(); ++slot)
+        EXPECT_EQ(render(*result.memory.get(slot)),
+                  render(*stored.values[slot].second));
+    }
+
+    // nodes are read in place
+    StoredNode pc = file.pc(0);
+    ASSERT_EQ(SN_BoolAnd, pc.kind());
+    StoredNode negative = pc.operand(0);
+    ASSERT_EQ(SN_IntLess, negative.kind());
+    EXPECT_EQ(negative.offset(), file.pc(1).operand(0).offset());
+    EXPECT_EQ("x", negative.operand(0).identifier());
+    EXPECT_EQ(0, negative.operand(1).value());
+    StoredNode sum = pc.operand(1).operand(0);
+    ASSERT_EQ(SN_LinearExpr, sum.kind());
+    ASSERT_EQ(2u, sum.termCount());
+    EXPECT_EQ("y", sum.termSymbol(1).identifier());
+    EXPECT_THROW(negative.identifier(), std::runtime_error);
+    EXPECT_THROW(file.pc(file.size()), std::runtime_error);
+  }
+
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << "[]";
+  }
+  EXPECT_THROW(ResultFile{path}, std::runtime_error);
+  std::filesystem::remove(path);
+}
+
+TEST(SymbolicMemoryTest, CopiesAreIndependent) {
+  // enough parameters for the value trie to need more than one level
+  auto function = std::make_shared<Function>();
+  for (int i = 0; i < 40; ++i)
+    function->parameters.push_back(Parameter{"p" + std::to_string(i), T_INT});
+  ExprFactory factory;
+  SymbolicMemory memory(function, factory);
+  SymbolicMemory fork = memory;
+  fork.set("p37", factory.intConst(1));
+  fork.set(3, factory.intConst(2));
+
+  EXPECT_EQ(40u, memory.size());
+  EXPECT_EQ(factory.intSymbol("p37"), memory.get("p37"));
+  EXPECT_EQ(factory.intSymbol("p3"), memory.get(3));
+  EXPECT_EQ(factory.intConst(1), fork.get(37));
+  EXPECT_EQ(factory.intConst(2), fork.get("p3"));
+  EXPECT_EQ(factory.intSymbol("p20"), fork.get("p20"));
+  EXPECT_THROW(fork.get("q"), std::runtime_error);
+  EXPECT_THROW(fork.get(40), std::runtime_error);
+  EXPECT_THROW(fork.set(40, factory.intConst(3)), std::runtime_error);
+
+  SymbolicMemory empty;
+  EXPECT_EQ(0u, empty.size());
+  EXPECT_THROW(empty.get("p0"), std::runtime_error);
+  EXPECT_THROW(empty.set("p0", factory.intConst(3)), std::runtime_error);
+  EXPECT_THROW(empty.get(0), std::runtime_error);
+  EXPECT_THROW(empty.name(0), std::runtime_error);
+}
+
+TEST(PathConditionTest, ForksSharePrefixConjunction) {
+  ExprFactory factory;
+  auto x = factory.intSymbol("x");
+  auto negative = factory.intLess(x, factory.intConst(0));
+  auto large = factory.intGreater(x, factory.intConst(5));
+
+  PathCondition empty;
+  EXPECT_TRUE(empty.empty());
+  EXPECT_EQ(factory.boolConst(true), empty.conjunction(factory));
+
+  PathCondition prefix = empty.extend(factory, negative);
+  PathCondition left = prefix.extend(factory, large);
+  PathCondition right = prefix.extend(factory, factory.boolNeg(large));
+  EXPECT_EQ(1u, prefix.size());
+  EXPECT_EQ(2u, left.size());
+  EXPECT_EQ(negative, prefix.conjunction(factory));
+  EXPECT_EQ(conjunction(factory, left.conjuncts()), left.conjunction(factory));
+  EXPECT_EQ((std::vector<std::shared_ptr<BoolExpression>>{
+                negative, factory.boolNeg(large)}),
+            right.conjuncts());
+  auto &leftAnd = static_cast<const BoolAnd &>(*left.conjunction(factory));
+  auto &rightAnd = static_cast<const BoolAnd &>(*right.conjunction(factory));
+  EXPECT_EQ(leftAnd.lhs, rightAnd.lhs);
+}
@@ -0,0 +1,354 @@
+#include "ExprFactory.h"
+#include "Interpreter.h"
+#include "QueryCache.h"
+#include "Solver.h"
+#include "gtest/gtest.h"
+#include <limits>
+
+using namespace mysym;
+
+namespace {
+
+class SolverTest : public ::testing::Test {
+protected:
+  SatResult check(std::vector<std::shared_ptr<BoolExpression>> conjuncts) {
+    SatResult result = checkSat(conjuncts, &model);
+    if (result == SatResult::Sat)
+      for (const auto &conjunct : conjuncts)
+        EXPECT_TRUE(model.satisfies(*conjunct)) << render(*conjunct);
+    return result;
+  }
+
+  std::shared_ptr<IntExpression> num(int64_t value) {
+    return factory.intConst(value);
+  }
+
+  ExprFactory factory;
+  std::shared_ptr<IntExpression> x = factory.intSymbol("x");
+  std::shared_ptr<IntExpression> y = factory.intSymbol("y");
+  std::shared_ptr<BoolExpression> b = factory.boolSymbol("b");
+  Model model;
+};
+
+} // namespace
+
+TEST_F(SolverTest, EmptyConjunctionIsSat) {
+  EXPECT_EQ(SatResult::Sat, check({}));
+}
+
+TEST_F(SolverTest, ConstantFalseIsUnsat) {
+  EXPECT_EQ(SatResult::Unsat, check({factory.boolConst(false)}));
+}
+
+TEST_F(SolverTest, ContradictingBoundsAreUnsat) {
+  EXPECT_EQ(SatResult::Unsat, check({factory.intLess(x, num(0)),
+                                     factory.intGreater(x, num(5))}));
+}
+
+TEST_F(SolverTest, BoundsProduceModel) {
+  EXPECT_EQ(SatResult::Sat, check({factory.intGreater(x, num(3)),
+                                   factory.intLess(x, num(7))}));
+  EXPECT_EQ(4, model.ints["x"]);
+}
+
+TEST_F(SolverTest, RelatesSymbols) {
+  // x < y, y < x + 1 has no integer solution
+  EXPECT_EQ(SatResult::Unsat,
+            check({factory.intLess(x, y),
+                   factory.intLess(y, factory.intAdd(x, num(1)))}));
+  EXPECT_EQ(SatResult::Sat, check({factory.intLess(x, y),
+                                   factory.intGreater(y, num(10)),
+                                   factory.intLess(x, num(-10))}));
+}
+
+TEST_F(SolverTest, TightensToIntegers) {
+  // 2x > 0 and 2x < 2 is satisfiable over the rationals only
+  auto twiceX = factory.intAdd(x, x);
+  EXPECT_EQ(SatResult::Unsat, check({factory.intGreater(twiceX, num(0)),
+                                     factory.intLess(twiceX, num(2))}));
+}
+
+TEST_F(SolverTest, SplitsOnDisjunctions) {
+  auto outside = factory.boolOr(factory.intLess(x, num(0)),
+                                factory.intGreater(x, num(10)));
+  EXPECT_EQ(SatResult::Sat, check({outside, factory.intGreater(x, num(5))}));
+  EXPECT_EQ(11, model.ints["x"]);
+  EXPECT_EQ(SatResult::Unsat, check({outside, factory.intGreater(x, num(5)),
+                                     factory.intLess(x, num(8))}));
+}
+
+TEST_F(SolverTest, NegatesComparisons) {
+  auto notLess = factory.boolNeg(factory.intLess(x, num(3)));
+  EXPECT_EQ(SatResult::Sat, check({notLess}));
+  EXPECT_EQ(3, model.ints["x"]);
+  EXPECT_EQ(SatResult::Unsat,
+            check({notLess, factory.boolNeg(factory.intGreater(x, num(2)))}));
+}
+
+TEST_F(SolverTest, MixesBoolsAndInts) {
+  auto implies = factory.boolOr(factory.boolNeg(b), factory.intLess(x, num(0)));
+  EXPECT_EQ(SatResult::Sat,
+            check({implies, b, factory.intGreater(y, x)}));
+  EXPECT_TRUE(model.bools["b"]);
+  EXPECT_EQ(SatResult::Unsat,
+            check({implies, b, factory.intGreater(x, num(0))}));
+}
+
+TEST_F(SolverTest, HandlesLargeConstants) {
+  auto max = num(std::numeric_limits<int64_t>::max());
+  EXPECT_EQ(SatResult::Sat, check({factory.intLess(x, max),
+                                   factory.intGreater(x, num(0))}));
+  // symbols are int64
+  EXPECT_EQ(SatResult::Unsat, check({factory.intGreater(x, max)}));
+}
+
+TEST_F(SolverTest, ArithmeticWraps) {
+  // only x = INT64_MAX, where x + 1 wraps around
+  auto wrapped = factory.intLess(factory.intAdd(x, num(1)), x);
+  EXPECT_EQ(SatResult::Sat, check({wrapped}));
+  EXPECT_EQ(std::numeric_limits<int64_t>::max(), model.ints["x"]);
+  EXPECT_EQ(SatResult::Unsat,
+            check({wrapped, factory.intLess(x, num(1000))}));
+
+  // x - y wraps in both directions
+  auto difference = factory.intSub(x, y);
+  EXPECT_EQ(SatResult::Sat, check({factory.intLess(difference, num(0)),
+                                   factory.intGreater(x, num(0)),
+                                   factory.intLess(y, num(0))}));
+  EXPECT_EQ(SatResult::Sat, check({factory.intGreater(difference, num(0)),
+                                   factory.intLess(x, num(0)),
+                                   factory.intGreater(y, num(0))}));
+}
+
+TEST_F(SolverTest, KeepsOverflowingBranches) {
+  auto checker = IFeasibilityChecker::createSolver();
+  auto wrapped = factory.intLess(factory.intAdd(x, num(1)), x);
+  EXPECT_TRUE(checker->isFeasible({wrapped}));
+  std::shared_ptr<const IFeasibilityChecker::Context> context;
+  EXPECT_TRUE(checker->extend(context, PathCondition(), wrapped));
+  EXPECT_FALSE(checker->extend(context, PathCondition(),
+                               factory.intLess(x, num(0))));
+}
+
+TEST_F(SolverTest, DecidesIntegerIte) {
+  auto ite = factory.intIte(b, x, factory.intAdd(y, num(1)));
+  EXPECT_EQ(SatResult::Sat, check({factory.intGreater(ite, num(5)),
+                                   factory.intLess(x, num(0))}));
+  EXPECT_FALSE(model.bools["b"]);
+  EXPECT_EQ(SatResult::Unsat,
+            check({factory.intGreater(ite, num(5)), factory.intLess(x, num(0)),
+                   factory.intLess(y, num(3))}));
+  // nested and under arithmetic
+  auto nested = factory.intIte(factory.intLess(y, num(0)), ite, num(7));
+  auto sum = factory.intAdd(nested, ite);
+  EXPECT_EQ(SatResult::Sat, check({factory.intLess(sum, num(-20))}));
+  EXPECT_EQ(SatResult::Unsat,
+            check({factory.intLess(sum, num(-20)), factory.intGreater(x, y),
+                   factory.intGreater(y, num(-10)),
+                   factory.intLess(x, num(100))}));
+  // without a bound on x, 2 * x wraps below -20
+  EXPECT_EQ(SatResult::Sat,
+            check({factory.intLess(sum, num(-20)), factory.intGreater(x, y),
+                   factory.intGreater(y, num(-10))}));
+}
+
+TEST_F(SolverTest, DecidesBooleanIte) {
+  auto ite = factory.boolIte(b, factory.intLess(x, num(0)),
+                             factory.intGreater(x, num(10)));
+  EXPECT_EQ(SatResult::Sat, check({ite, factory.intGreater(x, num(-5)),
+                                   factory.intLess(x, num(5))}));
+  EXPECT_TRUE(model.bools["b"]);
+  EXPECT_EQ(SatResult::Unsat,
+            check({factory.boolNeg(ite), b, factory.intLess(x, num(0))}));
+}
+
+TEST_F(SolverTest, GivesUpOnTooManyCases) {
+  // split last, so every combination of the others is tried before it
+  auto signs = [&](std::shared_ptr<IntExpression> value) {
+    return factory.boolAnd(factory.intLess(value, num(0)),
+                           factory.intGreater(value, num(0)));
+  };
+  std::vector<std::shared_ptr<BoolExpression>> conjuncts{
+      factory.boolOr(signs(x), signs(y))};
+  for (int i = 0; i < 16; ++i)
+    conjuncts.push_back(
+        factory.boolOr(factory.boolSymbol("p" + std::to_string(i)),
+                       factory.boolSymbol("q" + std::to_string(i))));
+  EXPECT_EQ(SatResult::Unknown, check(conjuncts));
+  conjuncts.resize(4);
+  EXPECT_EQ(SatResult::Unsat, check(conjuncts));
+}
+
+TEST_F(SolverTest, ContextStartsSat) {
+  EXPECT_EQ(SatResult::Sat, SolverContext::create()->status());
+}
+
+TEST_F(SolverTest, ContextAccumulatesConjuncts) {
+  auto root = SolverContext::create();
+  auto negative = root->assume(factory.intLess(x, num(0)));
+  ASSERT_EQ(SatResult::Sat, negative->status());
+  EXPECT_GT(0, negative->model().ints.at("x"));
+
+  auto both = negative->assume(factory.intGreater(x, num(5)));
+  EXPECT_EQ(SatResult::Unsat, both->status());
+  EXPECT_EQ(SatResult::Unsat,
+            both->assume(factory.boolConst(true))->status());
+
+  // forks of one context do not see each other's conjuncts
+  auto greater = factory.intGreater(y, x);
+  auto sibling = negative->assume(greater);
+  ASSERT_EQ(SatResult::Sat, sibling->status());
+  EXPECT_TRUE(sibling->model().satisfies(*greater));
+}
+
+TEST_F(SolverTest, ContextDetectsLiteralConflicts) {
+  auto context = SolverContext::create()->assume(b);
+  ASSERT_EQ(SatResult::Sat, context->status());
+  EXPECT_TRUE(context->model().bools.at("b"));
+  EXPECT_EQ(SatResult::Unsat,
+            context->assume(factory.boolNeg(b))->status());
+}
+
+TEST_F(SolverTest, ContextSplitsOnDisjunctions) {
+  auto context = SolverContext::create()->assume(factory.boolOr(
+      factory.intLess(x, num(0)), factory.intGreater(x, num(10))));
+  context = context->assume(factory.intGreater(x, num(-5)));
+  ASSERT_EQ(SatResult::Sat, context->status());
+  EXPECT_TRUE(context->model().satisfies(*factory.intGreater(x, num(10))) ||
+              context->model().satisfies(*factory.intLess(x, num(0))));
+  EXPECT_EQ(SatResult::Unsat,
+            context->assume(factory.intLess(x, num(5)))
+                ->assume(factory.intGreater(x, num(0)))
+                ->status());
+}
+
+TEST_F(SolverTest, CacheKeysAreCanonical) {
+  auto less = factory.intLess(x, num(0));
+  EXPECT_EQ(QueryCache::makeKey({less, b}), QueryCache::makeKey({b, less, b}));
+}
+
+TEST_F(SolverTest, CacheReusesAnswers) {
+  QueryCache cache;
+  auto negative = factory.intLess(x, num(0));
+  auto large = factory.intGreater(x, num(5));
+  auto small = factory.intLess(x, num(-5));
+
+  EXPECT_FALSE(cache.lookup(QueryCache::makeKey({negative, large})));
+  cache.insert(QueryCache::makeKey({negative, large}), SatResult::Unsat,
+               nullptr);
+  EXPECT_EQ(SatResult::Unsat,
+            cache.lookup(QueryCache::makeKey({large, negative})));
+  EXPECT_EQ(SatResult::Unsat,
+            cache.lookup(QueryCache::makeKey({negative, large, b})));
+
+  Model model;
+  model.ints["x"] = -10;
+  cache.insert(QueryCache::makeKey({negative, small}), SatResult::Sat,
+               std::make_shared<Model>(model));
+  EXPECT_EQ(SatResult::Sat, cache.lookup(QueryCache::makeKey({small})));
+  std::shared_ptr<const Model> found;
+  EXPECT_EQ(SatResult::Sat,
+            cache.lookup(QueryCache::makeKey({factory.intLess(x, num(-7))}),
+                         &found));
+  ASSERT_TRUE(found);
+  EXPECT_EQ(-10, found->ints.at("x"));
+
+  QueryCacheStats stats = cache.stats();
+  EXPECT_EQ(1u, stats.exactHits);
+  EXPECT_EQ(1u, stats.unsatSubsetHits);
+  EXPECT_EQ(1u, stats.satSupersetHits);
+  EXPECT_EQ(1u, stats.modelHits);
+  EXPECT_EQ(1u, stats.misses);
+}
+
+TEST_F(SolverTest, ContextConsultsCache) {
+  auto cache = std::make_shared<QueryCache>();
+  auto negative = factory.intLess(x, num(0));
+  auto large = factory.intGreater(x, num(5));
+  for (int i = 0; i < 2; ++i) {
+    auto context = SolverContext::create(cache)->assume(negative);
+    EXPECT_EQ(SatResult::Unsat, context->assume(large)->status());
+  }
+  // x < 0 and x < 0 & x > 5 are solved once each, then found exactly
+  EXPECT_EQ(2u, cache->stats().misses);
+  EXPECT_EQ(2u, cache->stats().exactHits);
+}
+
+TEST_F(SolverTest, GroupsIndependentConjuncts) {
+  auto z = factory.intSymbol("z");
+  auto onX = factory.intLess(x, num(0));
+  auto onB = factory.boolNeg(b);
+  auto onY = factory.intGreater(y, num(3));
+  auto onXZ = factory.intLess(z, x);
+  auto groups = independentGroups({onX, onB, onY, onXZ});
+  ASSERT_EQ(3u, groups.size());
+  EXPECT_EQ((std::vector<std::shared_ptr<BoolExpression>>{onX, onXZ}),
+            groups[0]);
+  EXPECT_EQ(std::vector<std::shared_ptr<BoolExpression>>{onB}, groups[1]);
+  EXPECT_EQ(std::vector<std::shared_ptr<BoolExpression>>{onY}, groups[2]);
+}
+
+TEST_F(SolverTest, ContextSolvesOnlyTheAffectedGroup) {
+  auto cache = std::make_shared<QueryCache>();
+  auto onX = factory.intLess(x, num(0));
+  auto onY = factory.intGreater(y, num(3));
+  auto context = SolverContext::create(cache)->assume(onX)->assume(onY);
+  ASSERT_EQ(SatResult::Sat, context->status());
+  EXPECT_TRUE(context->model().satisfies(*onX));
+  EXPECT_TRUE(context->model().satisfies(*onY));
+
+  // the query for y alone is already known from the first path
+  auto other = SolverContext::create(cache)
+                   ->assume(factory.intGreater(x, num(7)))
+                   ->assume(onY);
+  ASSERT_EQ(SatResult::Sat, other->status());
+  EXPECT_EQ(1u, cache->stats().exactHits);
+  EXPECT_TRUE(other->model().satisfies(*onY));
+}
+
+TEST_F(SolverTest, ContextJoinsGroupsThroughSharedSymbols) {
+  auto cache = std::make_shared<QueryCache>();
+  auto onX = factory.intLess(x, num(0));
+  auto onY = factory.intGreater(y, num(3));
+  auto context = SolverContext::create(cache)->assume(onX)->assume(onY);
+  EXPECT_EQ(SatResult::Unsat,
+            context->assume(factory.intLess(y, x))->status());
+
+  // the previous model already orders x below y, so nothing is solved
+  auto ordered = factory.intLess(x, y);
+  auto sibling = context->assume(ordered);
+  ASSERT_EQ(SatResult::Sat, sibling->status());
+  EXPECT_TRUE(sibling->model().satisfies(*ordered));
+  EXPECT_EQ(3u, cache->stats().misses);
+}
+
+TEST_F(SolverTest, CacheEvictsLeastRecentlyUsed) {
+  QueryCache cache(2);
+  auto negative = QueryCache::makeKey({factory.intLess(x, num(0))});
+  auto large = QueryCache::makeKey({factory.intGreater(x, num(5))});
+  auto either = QueryCache::makeKey({b});
+  cache.insert(negative, SatResult::Unknown, nullptr);
+  cache.insert(large, SatResult::Unknown, nullptr);
+  EXPECT_TRUE(cache.lookup(negative));
+  cache.insert(either, SatResult::Unknown, nullptr);
+
+  EXPECT_EQ(2u, cache.size());
+  EXPECT_EQ(1u, cache.stats().evictions);
+  EXPECT_TRUE(cache.lookup(negative));
+  EXPECT_FALSE(cache.lookup(large));
+  EXPECT_TRUE(cache.lookup(either));
+}
+
+TEST_F(SolverTest, CacheForgetsEvictedSubsets) {
+  QueryCache cache(1);
+  auto negative = factory.intLess(x, num(0));
+  auto large = factory.intGreater(x, num(5));
+  cache.insert(QueryCache::makeKey({negative, large}), SatResult::Unsat,
+               nullptr);
+  EXPECT_EQ(SatResult::Unsat,
+            cache.lookup(QueryCache::makeKey({negative, large, b})));
+  cache.insert(QueryCache::makeKey({b}), SatResult::Sat,
+               std::make_shared<Model>());
+  EXPECT_FALSE(cache.lookup(QueryCache::makeKey({negative, large, b})));
+  EXPECT_EQ(SatResult::Sat, cache.lookup(QueryCache::makeKey({b})));
+}